@@ -0,0 +1,501 @@
+#include "libcgr.cpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+
+using namespace cgr;
+
+// Route query benchmarks over a large contact plan, e.g.
+//     bench                      (generated plan, 20000 nodes)
+//     bench contactPlan.json     (any JSON contact plan)
+// Every variant answers the same queries and must find the same routes.
+
+// Random contact plan: every node has contacts to a few other nodes, and every
+// (from, to) pair has a series of non-overlapping contacts with one owlt.
+static std::vector<Contact> generate_plan(int num_nodes, int pairs_per_node, int contacts_per_pair) {
+	std::mt19937 rng(1);
+	std::vector<Contact> contact_plan;
+	for (int frm = 1; frm <= num_nodes; ++frm) {
+		std::set<int> neighbors;
+		while (neighbors.size() < static_cast<std::size_t>(pairs_per_node)) {
+			int to = 1 + rng() % num_nodes;
+			if (to != frm) {
+				neighbors.insert(to);
+			}
+		}
+		for (int to : neighbors) {
+			int owlt = 1 + rng() % 10;
+			int t = rng() % 100;
+			for (int i = 0; i < contacts_per_pair; ++i) {
+				int start = t + rng() % 200;
+				int end = start + 1 + rng() % 100;
+				contact_plan.push_back(Contact(frm, to, start, end, 1000, 1.0, owlt));
+				t = end;
+			}
+		}
+	}
+	return contact_plan;
+}
+
+// Random periodic plan: every (from, to) pair has one contact repeating `occurrences` times
+static std::vector<PeriodicContact> generate_periodic_plan(int num_nodes, int pairs_per_node, int occurrences) {
+	std::mt19937 rng(4);
+	std::vector<PeriodicContact> periodic_plan;
+	for (int frm = 1; frm <= num_nodes; ++frm) {
+		std::set<int> neighbors;
+		while (neighbors.size() < static_cast<std::size_t>(pairs_per_node)) {
+			int to = 1 + rng() % num_nodes;
+			if (to != frm) {
+				neighbors.insert(to);
+			}
+		}
+		for (int to : neighbors) {
+			int start = rng() % 100;
+			int duration = 1 + rng() % 20;
+			int period = duration + 50 + rng() % 100;
+			Contact contact(frm, to, start, start + duration, 1000, 1.0, 1 + rng() % 10);
+			periodic_plan.push_back(PeriodicContact(contact, period, occurrences));
+		}
+	}
+	return periodic_plan;
+}
+
+// Random plan over [0, span): every (from, to) pair has contacts_per_pair contacts, one in
+// each of contacts_per_pair equal time slots, so more contacts per pair means a denser plan
+static std::vector<Contact> generate_dense_plan(int num_nodes, int pairs_per_node, int contacts_per_pair, int span) {
+	std::mt19937 rng(6);
+	std::vector<Contact> contact_plan;
+	const int slot = span / contacts_per_pair;
+	for (int frm = 1; frm <= num_nodes; ++frm) {
+		std::set<int> neighbors;
+		while (neighbors.size() < static_cast<std::size_t>(pairs_per_node)) {
+			int to = 1 + rng() % num_nodes;
+			if (to != frm) {
+				neighbors.insert(to);
+			}
+		}
+		for (int to : neighbors) {
+			int owlt = 1 + rng() % 10;
+			for (int i = 0; i < contacts_per_pair; ++i) {
+				int start = i * slot + rng() % (slot / 2 + 1);
+				int end = start + 1 + rng() % (slot / 2 + 1);
+				contact_plan.push_back(Contact(frm, to, start, end, 1000, 1.0, owlt));
+			}
+		}
+	}
+	return contact_plan;
+}
+
+struct Query {
+	nodeId_t source, destination;
+	int start_time;
+};
+
+static std::vector<Query> generate_queries(const std::vector<Contact> &contact_plan, int num_queries) {
+	std::mt19937 rng(2);
+	std::vector<Query> queries;
+	for (int q = 0; q < num_queries; ++q) {
+		Query query;
+		query.source = contact_plan[rng() % contact_plan.size()].frm;
+		query.destination = contact_plan[rng() % contact_plan.size()].to;
+		query.start_time = rng() % 1000;
+		queries.push_back(query);
+	}
+	return queries;
+}
+
+// Runs every query and returns the time taken in milliseconds; the best delivery
+// times found are stored in `arrivals`
+static double run_queries(MultigraphRouter &router, const std::vector<Query> &queries, std::vector<int> &arrivals) {
+	arrivals.clear();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (const Query &query : queries) {
+		Route route = router.route(query.source, query.destination, query.start_time);
+		arrivals.push_back(route.empty() ? -1 : route.best_delivery_time);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// Multigraph search with each QueuePolicy
+static bool bench_queue_policies(MultigraphRouter &router, const std::vector<Query> &queries) {
+	std::vector<int> binary_arrivals, radix_arrivals;
+	router.set_queue_policy(BINARY_HEAP);
+	double binary_ms = run_queries(router, queries, binary_arrivals);
+	router.set_queue_policy(RADIX_HEAP);
+	double radix_ms = run_queries(router, queries, radix_arrivals);
+
+	std::cout << "queue policy, " << queries.size() << " queries" << std::endl;
+	std::cout << "  binary heap: " << binary_ms << " ms" << std::endl;
+	std::cout << "  radix heap:  " << radix_ms << " ms" << std::endl;
+	if (binary_arrivals != radix_arrivals) {
+		std::cerr << "  radix heap routes differ from binary heap routes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// route_batch() on thread pools of increasing size
+static bool bench_route_batch(MultigraphRouter &router, const std::vector<Query> &queries) {
+	std::vector<RouteQuery> batch;
+	for (const Query &query : queries) {
+		RouteQuery route_query = { query.source, query.destination, query.start_time };
+		batch.push_back(route_query);
+	}
+	std::vector<int> serial_arrivals;
+	run_queries(router, queries, serial_arrivals);
+
+	std::cout << "route_batch, " << batch.size() << " queries" << std::endl;
+	const unsigned max_workers = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned workers = 1; ; workers = std::min(2 * workers, max_workers)) {
+		ThreadPool pool(workers);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::vector<Route> routes = router.route_batch(batch, &pool);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		std::cout << "  " << workers << " workers: "
+			<< std::chrono::duration<double, std::milli>(end - begin).count() << " ms" << std::endl;
+		for (std::size_t i = 0; i < routes.size(); ++i) {
+			if ((routes[i].empty() ? -1 : routes[i].best_delivery_time) != serial_arrivals[i]) {
+				std::cerr << "  route_batch routes differ from route() routes" << std::endl;
+				return false;
+			}
+		}
+		if (workers == max_workers) {
+			break;
+		}
+	}
+	return true;
+}
+
+// Time data departing at start_time arrives over route, or -1 for an empty route
+static int delivery_time(Route &route, int start_time) {
+	if (route.empty()) {
+		return -1;
+	}
+	int arrival = start_time;
+	for (const Contact &hop : route.get_hops()) {
+		arrival = std::max(arrival, hop.start) + hop.owlt;
+	}
+	return arrival;
+}
+
+// RouteCache on forwarding-like traffic: bundles from a few sources to 20 destinations,
+// ten per time unit, in time order
+static bool bench_route_cache(MultigraphRouter &router, const std::vector<Contact> &contact_plan) {
+	std::mt19937 rng(3);
+	std::vector<Query> queries;
+	for (int i = 0; i < 4000; ++i) {
+		Query query;
+		query.source = contact_plan[rng() % 5].frm;
+		query.destination = contact_plan[(rng() % 20) * 7919 % contact_plan.size()].to;
+		query.start_time = i / 10;
+		queries.push_back(query);
+	}
+	std::vector<Route> uncached_routes, cached_routes;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (const Query &query : queries) {
+		uncached_routes.push_back(router.route(query.source, query.destination, query.start_time));
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	double uncached_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	RouteCache cache(router);
+	begin = std::chrono::steady_clock::now();
+	for (const Query &query : queries) {
+		cached_routes.push_back(cache.route(query.source, query.destination, query.start_time));
+		if (0 == query.start_time % 100) {
+			cache.expire(query.start_time);
+		}
+	}
+	end = std::chrono::steady_clock::now();
+	double cached_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	std::cout << "route cache, " << queries.size() << " queries" << std::endl;
+	std::cout << "  uncached: " << uncached_ms << " ms" << std::endl;
+	// A cached route only answers departures that arrive as early as the one it was found
+	// for, so every query whose earliest arrival differs from the previous query of its
+	// (source, destination) misses
+	std::map<std::pair<nodeId_t, nodeId_t>, int> previous_arrival;
+	std::size_t arrival_changes = 0;
+	for (std::size_t i = 0; i < queries.size(); ++i) {
+		const std::pair<nodeId_t, nodeId_t> key(queries[i].source, queries[i].destination);
+		const int arrival = delivery_time(uncached_routes[i], queries[i].start_time);
+		if (!previous_arrival.count(key) || previous_arrival[key] != arrival) {
+			++arrival_changes;
+		}
+		previous_arrival[key] = arrival;
+	}
+	std::cout << "  cached:   " << cached_ms << " ms, hit rate "
+		<< 100.0 * cache.hits() / (cache.hits() + cache.misses()) << "% (at most "
+		<< 100.0 * (queries.size() - arrival_changes) / queries.size() << "%)" << std::endl;
+	// a cached route may be a different route, but it must arrive as early
+	for (std::size_t i = 0; i < queries.size(); ++i) {
+		if (delivery_time(cached_routes[i], queries[i].start_time) != delivery_time(uncached_routes[i], queries[i].start_time)) {
+			std::cerr << "  cached routes differ from route() routes" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// A router whose time window follows the queries, against one that keeps the whole plan
+static bool bench_time_window(const std::vector<Contact> &contact_plan, const std::vector<Query> &queries) {
+	MultigraphRouter full_router(contact_plan), window_router(contact_plan);
+	int last_end = 0;
+	for (const Contact &contact : contact_plan) {
+		last_end = std::max(last_end, contact.end);
+	}
+
+	std::cout << "time window, " << queries.size() << " queries per step" << std::endl;
+	for (int now = 0; now < last_end; now += last_end / 5) {
+		window_router.graph().advance(now);
+		std::vector<Query> window_queries = queries;
+		for (Query &query : window_queries) {
+			query.start_time = now + query.start_time % 100;
+		}
+		std::vector<int> full_arrivals, window_arrivals;
+		double full_ms = run_queries(full_router, window_queries, full_arrivals);
+		double window_ms = run_queries(window_router, window_queries, window_arrivals);
+		std::cout << "  now " << now << ": whole plan " << full_ms << " ms, window "
+			<< window_ms << " ms over " << window_router.graph().num_contacts() << " contacts" << std::endl;
+		if (full_arrivals != window_arrivals) {
+			std::cerr << "  time window routes differ from whole plan routes" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Periodic contacts kept as descriptors, against the same plan with every occurrence stored
+static bool bench_periodic_plan() {
+	std::vector<PeriodicContact> periodic_plan = generate_periodic_plan(2000, 6, 200);
+	std::vector<Contact> expanded_plan;
+	for (const PeriodicContact &periodic_contact : periodic_plan) {
+		std::vector<Contact> occurrences = periodic_contact.occurrences();
+		expanded_plan.insert(expanded_plan.end(), occurrences.begin(), occurrences.end());
+	}
+	std::vector<Query> queries = generate_queries(expanded_plan, 1000);
+	for (Query &query : queries) {
+		query.start_time *= 10;
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	MultigraphRouter periodic_router(std::vector<Contact>(), periodic_plan);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	double periodic_build_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+	begin = std::chrono::steady_clock::now();
+	MultigraphRouter expanded_router(expanded_plan);
+	end = std::chrono::steady_clock::now();
+	double expanded_build_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	std::vector<int> periodic_arrivals, expanded_arrivals;
+	double periodic_ms = run_queries(periodic_router, queries, periodic_arrivals);
+	double expanded_ms = run_queries(expanded_router, queries, expanded_arrivals);
+	std::cout << "periodic plan, " << queries.size() << " queries" << std::endl;
+	std::cout << "  " << periodic_router.graph().num_periodic_contacts() << " periodic contacts: build "
+		<< periodic_build_ms << " ms, queries " << periodic_ms << " ms" << std::endl;
+	std::cout << "  " << expanded_router.graph().num_contacts() << " occurrences:       build "
+		<< expanded_build_ms << " ms, queries " << expanded_ms << " ms" << std::endl;
+	if (periodic_arrivals != expanded_arrivals) {
+		std::cerr << "  periodic plan routes differ from expanded plan routes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Opening a binary contact plan against building the multigraph from the contact plan, for
+// the plan as given and with a shorter-delay contact overlapping the second half of every
+// contact, whose envelopes are saved in the file rather than rebuilt on open
+static bool bench_mapped_open(const std::vector<Contact> &contact_plan, const std::vector<Query> &queries) {
+	const std::string filename = "bench_plan.cpbin";
+	std::vector<Contact> overlapping_plan = contact_plan;
+	for (const Contact &contact : contact_plan) {
+		const int middle = contact.start + (contact.end - contact.start) / 2;
+		overlapping_plan.push_back(Contact(contact.frm, contact.to, middle, contact.end + 10, 1000, 1.0, contact.owlt / 2));
+	}
+	bool ok = true;
+	std::cout << "binary contact plan, open vs build" << std::endl;
+	const std::vector<Contact> *plans[] = { &contact_plan, &overlapping_plan };
+	for (const std::vector<Contact> *plan : plans) {
+		cp_save_binary(*plan, filename);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		MultigraphRouter built_router(*plan);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		double build_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		const int opens = 100;
+		begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < opens; ++i) {
+			ContactMultigraph graph(filename);
+		}
+		end = std::chrono::steady_clock::now();
+		double open_ms = std::chrono::duration<double, std::milli>(end - begin).count() / opens;
+		MultigraphRouter mapped_router(filename);
+		std::vector<int> built_arrivals, mapped_arrivals;
+		run_queries(built_router, queries, built_arrivals);
+		run_queries(mapped_router, queries, mapped_arrivals);
+		std::cout << "  " << plan->size() << " contacts: build " << build_ms << " ms, open " << open_ms << " ms" << std::endl;
+		if (built_arrivals != mapped_arrivals) {
+			std::cerr << "  mapped plan routes differ from built plan routes" << std::endl;
+			ok = false;
+		}
+	}
+	std::remove(filename.c_str());
+	return ok;
+}
+
+// contact_search() with and without the per-pair search index, on plans of 1M contacts
+// split into pairs of 10 to 100k contacts
+static bool bench_contact_search() {
+	std::cout << "contact search, 2M lookups" << std::endl;
+	bool ok = true;
+	for (int pair_size = 10; pair_size <= 100000; pair_size *= 10) {
+		std::mt19937 rng(5);
+		std::vector<Contact> contact_plan;
+		const int num_pairs = 1000000 / pair_size;
+		for (int pair = 0; pair < num_pairs; ++pair) {
+			int t = rng() % 100;
+			for (int i = 0; i < pair_size; ++i) {
+				int start = t + rng() % 100;
+				int end = start + 1 + rng() % 50;
+				contact_plan.push_back(Contact(1 + pair / 8, 1000000 + pair % 8, start, end, 1000));
+				t = end;
+			}
+		}
+		ContactMultigraph graph(contact_plan);
+		const int span = 100 * pair_size;
+		std::vector<std::pair<uint32_t, int>> lookups;
+		for (int i = 0; i < 2000000; ++i) {
+			lookups.push_back(std::make_pair(rng() % graph.pair_frm.size(), static_cast<int>(rng() % span)));
+		}
+
+		double ms[2];
+		uint64_t checksum[2] = { 0, 0 };
+		for (int indexed = 0; indexed < 2; ++indexed) {
+			graph.build_search_index(indexed ? 32 : NO_INDEX);
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			for (const std::pair<uint32_t, int> &lookup : lookups) {
+				checksum[indexed] += graph.contact_search(lookup.first, lookup.second);
+			}
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			ms[indexed] = std::chrono::duration<double, std::milli>(end - begin).count();
+		}
+		std::cout << "  " << pair_size << " contacts per pair: binary search " << ms[0] << " ms, index " << ms[1] << " ms" << std::endl;
+		if (checksum[0] != checksum[1]) {
+			std::cerr << "  indexed contact search results differ from binary search" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// ConnectionScanRouter against MultigraphRouter on plans of increasing density: the scan
+// touches every contact in the time window a query spans, the multigraph search only the
+// first usable contact of each pair it reaches
+static bool bench_connection_scan() {
+	std::cout << "connection scan vs multigraph, 1000 nodes, 200 queries" << std::endl;
+	bool ok = true;
+	for (int contacts_per_pair = 5; contacts_per_pair <= 320; contacts_per_pair *= 4) {
+		std::vector<Contact> contact_plan = generate_dense_plan(1000, 6, contacts_per_pair, 10000);
+		std::vector<Query> queries = generate_queries(contact_plan, 200);
+		for (Query &query : queries) {
+			query.start_time *= 5;
+		}
+		MultigraphRouter multigraph_router(contact_plan);
+		ConnectionScanRouter scan_router(contact_plan);
+		// equally early routes may differ, so compare the times they deliver
+		std::vector<int> multigraph_arrivals, scan_arrivals;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (const Query &query : queries) {
+			Route route = multigraph_router.route(query.source, query.destination, query.start_time);
+			multigraph_arrivals.push_back(delivery_time(route, query.start_time));
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		double multigraph_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		begin = std::chrono::steady_clock::now();
+		for (const Query &query : queries) {
+			Route route = scan_router.route(query.source, query.destination, query.start_time);
+			scan_arrivals.push_back(delivery_time(route, query.start_time));
+		}
+		end = std::chrono::steady_clock::now();
+		double scan_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		std::cout << "  " << contact_plan.size() << " contacts (" << contacts_per_pair << " per pair): multigraph "
+			<< multigraph_ms << " ms, connection scan " << scan_ms << " ms" << std::endl;
+		if (multigraph_arrivals != scan_arrivals) {
+			std::cerr << "  connection scan routes differ from multigraph routes" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// One profile() call per (source, destination) pair against a route() call for every second
+// of an hour-long departure window
+static bool bench_arrival_profile() {
+	std::vector<Contact> contact_plan = generate_dense_plan(1000, 6, 20, 10000);
+	std::vector<Query> queries = generate_queries(contact_plan, 20);
+	ConnectionScanRouter router(contact_plan);
+	const int window = 3600;
+
+	std::vector<int> search_arrivals, profile_arrivals;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (const Query &query : queries) {
+		for (int departure = query.start_time; departure < query.start_time + window; ++departure) {
+			Route route = router.route(query.source, query.destination, departure);
+			search_arrivals.push_back(delivery_time(route, departure));
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	double search_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+	std::size_t pieces = 0;
+	begin = std::chrono::steady_clock::now();
+	for (const Query &query : queries) {
+		ArrivalProfile profile = router.profile(query.source, query.destination, query.start_time, query.start_time + window - 1);
+		pieces += profile.pieces.size();
+		for (int departure = query.start_time; departure < query.start_time + window; ++departure) {
+			int arrival = profile.arrival_time(departure);
+			profile_arrivals.push_back(MAX_SIZE == arrival ? -1 : arrival);
+		}
+	}
+	end = std::chrono::steady_clock::now();
+	double profile_ms = std::chrono::duration<double, std::milli>(end - begin).count();
+
+	std::cout << "arrival profile, " << queries.size() << " pairs, " << window << " departures each" << std::endl;
+	std::cout << "  route() per departure: " << search_ms << " ms" << std::endl;
+	std::cout << "  profile():             " << profile_ms << " ms, " << pieces << " pieces" << std::endl;
+	if (search_arrivals != profile_arrivals) {
+		std::cerr << "  profile arrivals differ from route() arrivals" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<Contact> contact_plan;
+	try {
+		contact_plan = argc > 1 ? cp_load(argv[1]) : generate_plan(20000, 6, 20);
+	}
+	catch (const ContactPlanError &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if (contact_plan.empty()) {
+		std::cerr << "empty contact plan" << std::endl;
+		return 1;
+	}
+	std::cout << contact_plan.size() << " contacts" << std::endl;
+
+	std::vector<Query> queries = generate_queries(contact_plan, 1000);
+	MultigraphRouter router(contact_plan);
+	bool ok = bench_queue_policies(router, queries);
+	router.set_queue_policy(BINARY_HEAP);
+	ok = bench_route_batch(router, queries) && ok;
+	ok = bench_route_cache(router, contact_plan) && ok;
+	ok = bench_time_window(contact_plan, std::vector<Query>(queries.begin(), queries.begin() + 200)) && ok;
+	ok = bench_periodic_plan() && ok;
+	ok = bench_mapped_open(contact_plan, std::vector<Query>(queries.begin(), queries.begin() + 200)) && ok;
+	ok = bench_contact_search() && ok;
+	ok = bench_connection_scan() && ok;
+	ok = bench_arrival_profile() && ok;
+	return ok ? 0 : 1;
+}
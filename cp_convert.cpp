@@ -0,0 +1,24 @@
+#include "libcgr.cpp"
+#include <iostream>
+
+using namespace cgr;
+
+// Converts a JSON contact plan into the binary contact plan format that
+// MultigraphRouter can memory map, e.g.
+//     cp_convert contactPlan_RoutingTest.json contactPlan_RoutingTest.cpbin
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		std::cerr << "usage: " << argv[0] << " <contact plan.json> <contact plan.cpbin>" << std::endl;
+		return 1;
+	}
+	try {
+		std::vector<Contact> contact_plan = cp_load(argv[1]);
+		cp_save_binary(contact_plan, argv[2]);
+		std::cout << "Wrote " << contact_plan.size() << " contacts to " << argv[2] << std::endl;
+	}
+	catch (const ContactPlanError &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -1,13 +1,25 @@
 #include "libcgr.h"
 
-//#include <boost/property_tree/ptree.hpp>
-//#include <boost/property_tree/json_parser.hpp>
-
-#include "boost/property_tree/ptree.hpp"
-#include "boost/property_tree/json_parser.hpp"
-
+// Boost.JSON is used header-only: the library sources are compiled into this translation unit
+#include "boost/json/basic_parser_impl.hpp"
+#include "boost/json/src.hpp"
+#include "boost/format.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <iostream>
-#include <queue>
 
 namespace cgr {
 
@@ -21,7 +33,7 @@ void Contact::clear_dijkstra_working_area() {
     visited_nodes.clear();
 }
 
-bool Contact::operator==(const Contact contact) const {
+bool Contact::operator==(const Contact &contact) const {
     return (frm == contact.frm &&
             to == contact.to &&
             start == contact.start &&
@@ -31,7 +43,7 @@ bool Contact::operator==(const Contact contact) const {
             confidence == contact.confidence);
 }
 
-bool Contact::operator!=(const Contact contact) const {
+bool Contact::operator!=(const Contact &contact) const {
     return !(*this == contact);
 }
 
@@ -40,9 +52,10 @@ Contact::Contact(nodeId_t frm, nodeId_t to, int start, int end, int rate, float
 {
     // fixed parameters
     volume = rate * (end - start);
+    id = -1;
 
     // variable parameters
-    mav = std::vector<int>({volume, volume, volume});
+    mav = {{ volume, volume, volume }};
 
     // route search working area
     arrival_time = MAX_SIZE;
@@ -67,108 +80,324 @@ Contact::Contact()
 
 Contact::~Contact() {}
 
+PeriodicContact::PeriodicContact(const Contact &contact, int period, int count)
+    : contact(contact), period(period), count(count)
+{
+    if (count < 1) {
+        throw std::invalid_argument("periodic contact must occur at least once");
+    }
+    if (contact.start >= contact.end) {
+        throw std::invalid_argument("contact must end after it starts");
+    }
+    if (period <= 0) {
+        throw std::invalid_argument("period must be positive");
+    }
+    if (count > 1 && period < static_cast<int64_t>(contact.end) - contact.start) {
+        throw std::invalid_argument("occurrences of a periodic contact overlap");
+    }
+    // occurrence times are ints
+    if (last_end() > std::numeric_limits<int>::max()) {
+        throw std::invalid_argument("periodic contact ends after the largest time");
+    }
+}
+
+PeriodicContact PeriodicContact::until(const Contact &contact, int period, int until) {
+    const int64_t count = until < contact.end || period <= 0 ? 0 : (static_cast<int64_t>(until) - contact.end) / period + 1;
+    if (count > std::numeric_limits<int>::max()) {
+        throw std::invalid_argument("too many occurrences of a periodic contact");
+    }
+    return PeriodicContact(contact, period, static_cast<int>(count));
+}
+
+int64_t PeriodicContact::last_end() const {
+    return contact.end + static_cast<int64_t>(count - 1) * period;
+}
+
+Contact PeriodicContact::occurrence(int i) const {
+    Contact c(contact.frm, contact.to, contact.start + i * period, contact.end + i * period,
+              contact.rate, contact.confidence, contact.owlt);
+    c.id = contact.id;
+    return c;
+}
+
+std::vector<Contact> PeriodicContact::occurrences() const {
+    std::vector<Contact> contacts;
+    contacts.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        contacts.push_back(occurrence(i));
+    }
+    return contacts;
+}
+
+uint32_t ContactStore::size() const {
+    return start.size();
+}
+
+void ContactStore::reserve(uint32_t n) {
+    frm.reserve(n);
+    to.reserve(n);
+    start.reserve(n);
+    end.reserve(n);
+    owlt.reserve(n);
+    rate.reserve(n);
+    id.reserve(n);
+    confidence.reserve(n);
+}
+
+void ContactStore::push_back(const Contact &contact) {
+    frm.push_back(contact.frm);
+    to.push_back(contact.to);
+    start.push_back(contact.start);
+    end.push_back(contact.end);
+    owlt.push_back(contact.owlt);
+    rate.push_back(contact.rate);
+    id.push_back(contact.id);
+    confidence.push_back(contact.confidence);
+}
+
+Contact ContactStore::contact(uint32_t i) const {
+    Contact contact(frm[i], to[i], start[i], end[i], rate[i], confidence[i], owlt[i]);
+    contact.id = id[i];
+    return contact;
+}
+
+// One hop of a Route, shared by every route that extends the hops up to it
+struct Route::Hop {
+    Contact contact;
+    std::shared_ptr<const Hop> previous;
+    // number of hops up to this one
+    uint32_t count;
+    // when the first byte can be sent over this hop (bundle transmission time is not modelled)
+    int first_byte_tx_time;
+    // smallest contact volume of the hops up to this one
+    int min_contact_volume;
+    // bit node % 64 set for every node visited up to this hop, to rule out most visited() walks
+    uint64_t node_bits;
+};
+
+// Group of the last `hops` hops before the next group that share the same effective stop time.
+// Groups are stacked with increasing stop times; a hop that ends before some of them merges
+// with them, since it shortens their effective stop time to its own end.
+struct Route::VolumeGroup {
+    int stop;
+    uint32_t hops;
+    // the hops' common rate, if same_rate
+    bool same_rate;
+    int rate;
+    // smallest effective volume limit of the hops of this group and of the groups below it
+    int limit;
+    std::shared_ptr<const VolumeGroup> previous;
+};
+
+// Per-thread free lists of the memory blocks of route hops and volume groups. Queries build and
+// drop routes hop by hop, so the blocks are reused instead of going back to the global heap.
+// Routes outlive queries and may be dropped on another thread, whose lists then take the
+// block. Each list keeps at most MAX_BLOCKS blocks; the others, and the blocks freed after the
+// thread's lists are gone, go back to the heap.
+class RouteBlockPool {
+public:
+    RouteBlockPool() : lists(), sizes() {}
+    ~RouteBlockPool() {
+        closed = true;
+        for (Block *list : lists) {
+            while (list) {
+                Block *next = list->next;
+                ::operator delete(list);
+                list = next;
+            }
+        }
+    }
+    static void* allocate(std::size_t bytes) {
+        const std::size_t c = size_class(bytes);
+        if (c >= NUM_CLASSES || closed) {
+            return ::operator new(bytes);
+        }
+        RouteBlockPool &pool = local;
+        Block *block = pool.lists[c];
+        if (!block) {
+            return ::operator new((c + 1) * GRANULE);
+        }
+        pool.lists[c] = block->next;
+        --pool.sizes[c];
+        return block;
+    }
+    static void free(void *p, std::size_t bytes) {
+        const std::size_t c = size_class(bytes);
+        if (c >= NUM_CLASSES || closed) {
+            ::operator delete(p);
+            return;
+        }
+        RouteBlockPool &pool = local;
+        if (pool.sizes[c] == MAX_BLOCKS) {
+            ::operator delete(p);
+            return;
+        }
+        Block *block = static_cast<Block*>(p);
+        block->next = pool.lists[c];
+        pool.lists[c] = block;
+        ++pool.sizes[c];
+    }
+private:
+    struct Block {
+        Block *next;
+    };
+    static const std::size_t GRANULE = 16, NUM_CLASSES = 32, MAX_BLOCKS = 4096;
+    static std::size_t size_class(std::size_t bytes) {
+        return (bytes + GRANULE - 1) / GRANULE - 1;
+    }
+    Block *lists[NUM_CLASSES];
+    uint32_t sizes[NUM_CLASSES];
+    static thread_local RouteBlockPool local;
+    // set once the thread's lists are destroyed, for routes dropped by later thread exit code
+    static thread_local bool closed;
+};
+
+thread_local RouteBlockPool RouteBlockPool::local;
+thread_local bool RouteBlockPool::closed = false;
+
+// Allocator for std::allocate_shared that takes its blocks from RouteBlockPool
+template <typename T>
+class RouteAllocator {
+public:
+    typedef T value_type;
+    RouteAllocator() {}
+    template <typename U>
+    RouteAllocator(const RouteAllocator<U> &) {}
+    T* allocate(std::size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "route blocks are only max_align_t aligned");
+        return static_cast<T*>(RouteBlockPool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, std::size_t n) {
+        RouteBlockPool::free(p, n * sizeof(T));
+    }
+    template <typename U>
+    bool operator==(const RouteAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const RouteAllocator<U> &) const { return false; }
+};
+
+static uint64_t node_bit(nodeId_t node) {
+    return static_cast<uint64_t>(1) << (node % 64);
+}
+
 Route::Route()
 {
+    to_node = 0;
+    next_node = 0;
+    from_time = 0;
+    to_time = MAX_SIZE;
+    best_delivery_time = 0;
+    volume = MAX_SIZE;
+    confidence = 1;
 }
 
 Route::~Route() {}
 
 Route::Route(Contact contact, Route *parent)
-    : parent(parent)
 {
-    hops = std::vector<Contact>();
     if (NULL == parent) {
-        // to_node = NULL;
-        // next_node = NULL;
+        to_node = 0;
+        next_node = 0;
         from_time = 0;
         to_time = MAX_SIZE;
         best_delivery_time = 0;
         volume = MAX_SIZE;
         confidence = 1;
-        __visited = std::map<nodeId_t, bool>();
     } else {
-        to_node = parent->to_node;
-        next_node = parent->next_node;
-        from_time = parent->from_time;
-        to_time = parent->to_time;
-        best_delivery_time = parent->best_delivery_time;
-        volume = parent->volume;
-        confidence = parent->confidence;
-        __visited = std::map<nodeId_t, bool>(parent->__visited); // copy
+        // shares the parent's hops
+        *this = *parent;
     }
 
     append(contact);
 }
 
 Contact Route::get_last_contact() {
-    if (hops.empty()) {
+    if (!last) {
         throw EmptyContainerError();
     } else {
-        return hops.back();
+        return last->contact;
     }
 }
 
+bool Route::empty() const {
+    return !last;
+}
+
 bool Route::visited(nodeId_t node) {
-    //const int id = node;
-    return __visited.count(node) && __visited[node];
+    if (!last || !(last->node_bits & node_bit(node))) {
+        return false;
+    }
+    for (const Hop *hop = last.get(); hop; hop = hop->previous.get()) {
+        if (hop->contact.frm == node || hop->contact.to == node) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void Route::append(Contact contact) {
     assert(eligible(contact));
-    hops.push_back(contact);
-    __visited[contact.frm] = true;
-    __visited[contact.to] = true;
+    std::shared_ptr<Hop> hop = std::allocate_shared<Hop>(RouteAllocator<Hop>());
+    hop->contact = contact;
+    hop->previous = last;
+    if (!last) {
+        hop->count = 1;
+        hop->first_byte_tx_time = contact.start;
+        hop->min_contact_volume = contact.volume;
+        hop->node_bits = node_bit(contact.frm);
+        next_node = contact.to;
+        from_time = contact.start;
+    } else {
+        hop->count = last->count + 1;
+        hop->first_byte_tx_time = std::max(contact.start, last->first_byte_tx_time + last->contact.owlt);
+        hop->min_contact_volume = std::min(last->min_contact_volume, contact.volume);
+        hop->node_bits = last->node_bits;
+    }
+    hop->node_bits |= node_bit(contact.to);
+    to_node = contact.to;
+    to_time = std::min(to_time, contact.end);
+    best_delivery_time = std::max(best_delivery_time + contact.owlt, contact.start + contact.owlt);
+    confidence *= contact.confidence;
+
+    // The new hop cuts short the stop time of the groups that stop at or after its end. Each
+    // group is merged once, so this is O(1) amortised.
+    std::shared_ptr<VolumeGroup> group = std::allocate_shared<VolumeGroup>(RouteAllocator<VolumeGroup>());
+    group->stop = contact.end;
+    group->hops = 1;
+    group->same_rate = true;
+    group->rate = contact.rate;
+    std::shared_ptr<const VolumeGroup> below = volume_groups;
+    while (below && below->stop >= contact.end) {
+        group->hops += below->hops;
+        group->same_rate = group->same_rate && below->same_rate && below->rate == contact.rate;
+        below = below->previous;
+    }
+    group->previous = below;
+    int limit;
+    if (group->same_rate) {
+        // first byte times do not decrease along the route, so the new hop has the least time left
+        limit = (contact.end - hop->first_byte_tx_time) * contact.rate;
+    } else {
+        limit = MAX_SIZE;
+        const Hop *member = hop.get();
+        for (uint32_t i = 0; i < group->hops; ++i, member = member->previous.get()) {
+            limit = std::min(limit, (contact.end - member->first_byte_tx_time) * member->contact.rate);
+        }
+    }
+    group->limit = below ? std::min(below->limit, limit) : limit;
+    volume = std::min(group->limit, hop->min_contact_volume);
 
-    refresh_metrics();
+    last = hop;
+    volume_groups = group;
 }
 
 void Route::refresh_metrics() {
-    assert(!hops.empty());
-    std::vector<Contact> allHops = get_hops();
-    to_node = allHops.back().to;
-    next_node = allHops[0].to;
-    from_time = allHops[0].start;
-    to_time = MAX_SIZE;
-    best_delivery_time = 0;
-    confidence = 1;
-    for (Contact contact : allHops) {
-        to_time = std::min(to_time, contact.end);
-        best_delivery_time = std::max(best_delivery_time + contact.owlt, contact.start + contact.owlt);
-        confidence *= contact.confidence;
-    }
-
-    // volume
-    int prev_last_byte_arr_time = 0;
-    int min_effective_volume_limit = MAX_SIZE;
-    for (Contact& contact : allHops) {
-        if (contact == allHops[0]) {
-            contact.first_byte_tx_time = contact.start;
-        }
-        else {
-            contact.first_byte_tx_time = std::max(contact.start, prev_last_byte_arr_time);
-        }
-        int bundle_tx_time = 0;
-        contact.last_byte_tx_time = contact.first_byte_tx_time + bundle_tx_time;
-        contact.last_byte_arr_time = contact.last_byte_tx_time + contact.owlt;
-        prev_last_byte_arr_time = contact.last_byte_arr_time;
-
-        int effective_start_time = contact.first_byte_tx_time;
-        int min_succ_stop_time = MAX_SIZE;
-        std::vector<Contact>::iterator it = std::find(allHops.begin(), allHops.end(), contact);
-        for (it; it < allHops.end(); ++it) {
-            Contact successor = *it;
-            if (successor.end < min_succ_stop_time) {
-                min_succ_stop_time = successor.end;
-            }
-        }
-        int effective_stop_time = std::min(contact.end, min_succ_stop_time);
-        int effective_duration = effective_stop_time - effective_start_time;
-        contact.effective_volume_limit = std::min(effective_duration * contact.rate, contact.volume);
-        if (contact.effective_volume_limit < min_effective_volume_limit) {
-            min_effective_volume_limit = contact.effective_volume_limit;
-        }
+    assert(last);
+    std::vector<Contact> hops = get_hops();
+    *this = Route();
+    for (const Contact &contact : hops) {
+        append(contact);
     }
-    volume = min_effective_volume_limit;
 }
 
 bool Route::eligible(Contact contact) {
@@ -181,15 +410,13 @@ bool Route::eligible(Contact contact) {
     }
 }
 
-std::vector<Contact> Route::get_hops() {
-    if (NULL == parent) {
-        return hops;
-    }
-    else {
-        std::vector<Contact> v(parent->get_hops());
-        v.insert(v.end(), hops.begin(), hops.end());
-        return v;
+std::vector<Contact> Route::get_hops() const {
+    std::vector<Contact> hops(last ? last->count : 0);
+    std::size_t i = hops.size();
+    for (const Hop *hop = last.get(); hop; hop = hop->previous.get()) {
+        hops[--i] = hop->contact;
     }
+    return hops;
 }
 
 Vertex::Vertex() {
@@ -198,406 +425,3192 @@ Vertex::Vertex() {
 
 Vertex::Vertex(nodeId_t node_id) {
     id = node_id;
-    adjacencies = std::unordered_map<nodeId_t, std::vector<Contact>>();
     arrival_time = MAX_SIZE;
     visited = false;
-    predecessor = NULL;
+    predecessor = NO_INDEX;
 }
 
 bool Vertex::operator<(const Vertex& v) const {
     return arrival_time < v.arrival_time;
 }
 
-bool CompareArrivals::operator()(const Vertex* v1, const Vertex* v2) {
-    // smaller id breaks tie
-    if (v1->arrival_time == v2->arrival_time) {
-        return v1->id > v2->id;
+bool CompareArrivals::operator()(const QueueEntry &e1, const QueueEntry &e2) const {
+    // smaller id breaks tie. Dense indices are assigned in node id order,
+    // so comparing indices is the same as comparing ids.
+    if (e1.arrival_time == e2.arrival_time) {
+        return e1.vertex > e2.vertex;
     }
-    return v1->arrival_time > v2->arrival_time;
+    return e1.arrival_time > e2.arrival_time;
 }
 
+// Maps an arrival time to an unsigned key with the same order
+static uint32_t radix_key(int arrival_time) {
+    return static_cast<uint32_t>(arrival_time) ^ 0x80000000u;
+}
 
-ContactMultigraph::ContactMultigraph(std::vector<Contact> contact_plan, nodeId_t dest_id) {
-    vertices = std::unordered_map<nodeId_t, Vertex*>();
-    auto vertices_end = vertices.end();
-    for (Contact& contact : contact_plan) {
-        if (vertices.find(contact.frm) == vertices_end) { // if the frm vertex does not exist
-            Vertex frm(contact.frm);
-            // Put contact in `frm node`'s adjacency list to `to node`
-            std::vector<Contact> adj = frm.adjacencies[contact.to];
-            adj.push_back(contact);
-            vertices.insert({ contact.frm, & frm });
-        }
-        else { // if the frm vertex does exist
-            // Get list of contacts from `from node` to `to node`
-            std::vector<Contact> adj = vertices[contact.frm]->adjacencies[contact.to];
-            // If the contact list is empty or the latest contact in the list is
-            // earlier than the current contact's start, put the current contact at the end of the list
-            if (adj.empty() || contact.start > adj.back().start) {
-                vertices[contact.frm]->adjacencies[contact.to].push_back(contact);
-            }
-            else { // if the current contact needs to be inserted somewhere inside the list
-                // assuming non-overlapping contacts
-                // find the index that the contact needs to be inserted at
-                int index = cgr::contact_search_index(adj, contact.start);
-                // insert contact sorted by start time
-                vertices[contact.frm]->adjacencies[contact.to].insert(vertices[contact.frm]->adjacencies[contact.to].begin() + index, contact);
-            }
-        }
-    }
-    // Ensure the destination vertex exists since we're building vertices in the contact plan based on
-    // the contact's `frm`. Any other node that is only `to` but never `frm` we can ignore and not construct
-    // because it will never be part of the optimal path
-    if (vertices.find(dest_id) == vertices_end) {
-        Vertex dest(dest_id);
-        vertices.insert({ dest_id, & dest });
-    }
+RadixQueue::RadixQueue()
+    : last(0), count(0)
+{
 }
 
+bool RadixQueue::empty() const {
+    return 0 == count;
+}
 
-/*
- * Library function implementations, e.g. loading, routing algorithms, etc.
- */
-std::vector<Contact> cp_load(std::string filename, int max_contacts) {
-    std::vector<Contact> contactsVector;
-    boost::property_tree::ptree pt;
-    boost::property_tree::read_json(filename, pt);
-    const boost::property_tree::ptree & contactsPt
-        = pt.get_child("contacts", boost::property_tree::ptree());
-    for (const boost::property_tree::ptree::value_type &eventPt : contactsPt) {
-        Contact new_contact = Contact(eventPt.second.get<int>("source", 0),
-                                      eventPt.second.get<int>("dest", 0),
-                                      eventPt.second.get<int>("startTime", 0),
-                                      eventPt.second.get<int>("endTime", 0),
-                                      eventPt.second.get<int>("rate", 0));
-        // new_contact.id = eventPt.second.get<int>("contact", 0);
-        contactsVector.push_back(new_contact);
-        if (contactsVector.size() == max_contacts) {
-            break;
-        }
+unsigned RadixQueue::bucket(uint32_t key) const {
+    uint32_t diff = key ^ last;
+    if (0 == diff) {
+        return 0;
     }
-    return contactsVector;
+#if defined(__GNUC__)
+    return 32 - __builtin_clz(diff);
+#else
+    unsigned bit = 0;
+    while (diff) {
+        ++bit;
+        diff >>= 1;
+    }
+    return bit;
+#endif
 }
 
-Route dijkstra(Contact *root_contact, nodeId_t destination, std::vector<Contact> contact_plan) {
-    // Need to clear the real contacts in the contact plan
-    // so we loop using Contact& instead of Contact
-    for (Contact &contact : contact_plan) {
-        if (contact != *root_contact) {
-            contact.clear_dijkstra_working_area();
-        }
+void RadixQueue::push(const QueueEntry &entry) {
+    const uint32_t key = radix_key(entry.arrival_time);
+    assert(key >= last);
+    const unsigned b = bucket(key);
+    buckets[b].push_back(entry);
+    if (0 == b) {
+        std::push_heap(buckets[0].begin(), buckets[0].end(), CompareArrivals());
     }
+    ++count;
+}
 
-    // Make sure we map to pointers so we can modify the underlying contact_plan
-    // using the hashmap. The hashmap helps us find the neighbors of a node.
-    std::map<nodeId_t, std::vector<Contact*>> contact_plan_hash;
-    for (Contact &contact : contact_plan ) {
-        if (!contact_plan_hash.count(contact.frm)) {
-            contact_plan_hash[contact.frm] = std::vector<Contact*>();
-        }
-        if (!contact_plan_hash.count(contact.to)) {
-            contact_plan_hash[contact.to] = std::vector<Contact*>();
-        }
-        contact_plan_hash[contact.frm].push_back(&contact);
+void RadixQueue::refill() {
+    if (!buckets[0].empty()) {
+        return;
     }
+    unsigned b = 1;
+    while (buckets[b].empty()) {
+        ++b;
+    }
+    std::vector<QueueEntry> &from = buckets[b];
+    last = radix_key(from[0].arrival_time);
+    for (const QueueEntry &entry : from) {
+        last = std::min(last, radix_key(entry.arrival_time));
+    }
+    // every entry of bucket b now differs from last in a lower bit, or not at all
+    for (const QueueEntry &entry : from) {
+        buckets[bucket(radix_key(entry.arrival_time))].push_back(entry);
+    }
+    from.clear();
+    std::make_heap(buckets[0].begin(), buckets[0].end(), CompareArrivals());
+}
 
-    Route route;
-    Contact *final_contact = NULL;
-    int earliest_fin_arr_t = MAX_SIZE;
-    int arrvl_time;
+const QueueEntry& RadixQueue::top() {
+    refill();
+    return buckets[0].front();
+}
 
-    Contact *current = root_contact;
+void RadixQueue::pop() {
+    refill();
+    std::pop_heap(buckets[0].begin(), buckets[0].end(), CompareArrivals());
+    buckets[0].pop_back();
+    --count;
+}
 
-    if (!vector_contains(root_contact->visited_nodes, root_contact->to)) {
-        root_contact->visited_nodes.push_back(root_contact->to);
+void RadixQueue::clear() {
+    for (std::vector<QueueEntry> &b : buckets) {
+        b.clear();
     }
+    last = 0;
+    count = 0;
+}
 
-    while (true) {
-        // loop over the neighbors of the current contact's source node
-        for (Contact* contact : contact_plan_hash[current->to]) {
-            if (vector_contains(current->suppressed_next_hop, *contact)) {
-                continue;
-            }
-            if (contact->suppressed) {
-                continue;
-            }
-            if (contact->visited) {
-                continue;
-            }
-            if (vector_contains(current->visited_nodes, contact->to)) {
-                continue;
-            }
-            if (contact->end <= current->arrival_time) {
-                continue;
-            }
-            if (*std::max_element(contact->mav.begin(), contact->mav.end()) <= 0) {
-                continue;
-            }
-            if (current->frm == contact->to && current->to == contact->frm) {
-                continue;
-            }
+bool BinaryQueue::empty() const {
+    return heap.empty();
+}
 
-            // Calculate arrival time (cost)
-            if (contact->start < current->arrival_time) {
-                arrvl_time = current->arrival_time + contact->owlt;
-            } else {
-                arrvl_time = contact->start + contact->owlt;
-            }
-
-            if (arrvl_time <= contact->arrival_time) {
-                contact->arrival_time = arrvl_time;
-                contact->predecessor = current;
-                contact->visited_nodes = current->visited_nodes;
-                contact->visited_nodes.push_back(contact->to);
-                
-                if (contact->to == destination && contact->arrival_time < earliest_fin_arr_t) {
-                    earliest_fin_arr_t = contact->arrival_time;
-                    final_contact = &(*contact);
-                }
-            }
-        }
+void BinaryQueue::push(const QueueEntry &entry) {
+    heap.push_back(entry);
+    std::push_heap(heap.begin(), heap.end(), CompareArrivals());
+}
 
-        current->visited = true;
+const QueueEntry& BinaryQueue::top() const {
+    return heap.front();
+}
 
-        // determine next best contact
-        int earliest_arr_t = MAX_SIZE;
-        Contact *next_contact = NULL;
-        // @source DtnSim
-        // "Warning: we need to point finalContact to
-        // the real contact in contactPlan..."
-        // This is why we loop with a Contact& rather than a Contact
-        for (Contact &contact : contact_plan) {
-            if (contact.suppressed || contact.visited) {
-                continue;
-            }
-            if (contact.arrival_time > earliest_fin_arr_t) {
-                continue;
-            }
-            if (contact.arrival_time < earliest_arr_t) {
-                earliest_arr_t = contact.arrival_time;
-                next_contact = &contact;
-            }
-        }
+void BinaryQueue::pop() {
+    std::pop_heap(heap.begin(), heap.end(), CompareArrivals());
+    heap.pop_back();
+}
 
-        if (NULL == next_contact) {
-            break;
-        }
+void BinaryQueue::clear() {
+    heap.clear();
+}
+
+void IndexedQueue::resize(uint32_t num_vertices) {
+    position.resize(num_vertices);
+}
+
+bool IndexedQueue::empty() const {
+    return heap.empty();
+}
 
-        current = next_contact;
+void IndexedQueue::push(const QueueEntry &entry) {
+    heap.push_back(entry);
+    sift_up(heap.size() - 1, entry);
+}
+
+void IndexedQueue::decrease(const QueueEntry &entry) {
+    sift_up(position[entry.vertex], entry);
+}
+
+const QueueEntry& IndexedQueue::top() const {
+    return heap.front();
+}
+
+void IndexedQueue::pop() {
+    const QueueEntry last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+        sift_down(0, last);
     }
+}
 
-    if (final_contact != NULL) {
-        std::vector<Contact> hops;
-        Contact contact;
-        for (contact = *final_contact; contact != *root_contact; contact = *contact.predecessor) {
-            hops.push_back(contact);
+void IndexedQueue::clear() {
+    heap.clear();
+}
+
+void IndexedQueue::sift_up(uint32_t i, const QueueEntry &entry) {
+    // CompareArrivals(a, b) holds if a comes after b
+    while (i > 0 && CompareArrivals()(heap[(i - 1) / 4], entry)) {
+        heap[i] = heap[(i - 1) / 4];
+        position[heap[i].vertex] = i;
+        i = (i - 1) / 4;
+    }
+    heap[i] = entry;
+    position[entry.vertex] = i;
+}
+
+void IndexedQueue::sift_down(uint32_t i, const QueueEntry &entry) {
+    const uint32_t n = heap.size();
+    while (4 * i + 1 < n) {
+        uint32_t child = 4 * i + 1;
+        const uint32_t last_child = std::min(4 * i + 4, n - 1);
+        for (uint32_t j = child + 1; j <= last_child; ++j) {
+            if (CompareArrivals()(heap[child], heap[j])) {
+                child = j;
+            }
         }
-        
-        route = Route(hops.back());
-        hops.pop_back();
-        while (!hops.empty()) {
-            route.append(hops.back());
-            hops.pop_back();
+        if (!CompareArrivals()(entry, heap[child])) {
+            break;
         }
+        heap[i] = heap[child];
+        position[heap[i].vertex] = i;
+        i = child;
     }
+    heap[i] = entry;
+    position[entry.vertex] = i;
+}
 
-    return route;
 
+ContactMultigraph::ContactMultigraph(const std::vector<Contact> &contact_plan, nodeId_t dest_id)
+    : updates(0), num_rebuilds(0), search_min_contacts(32), window_start(std::numeric_limits<int>::min()),
+      num_expired(0), num_removed(0)
+{
+    // Ensure the destination vertex exists even if no contact in the plan mentions it
+    build(contact_plan, std::vector<PeriodicContact>(), std::vector<nodeId_t>(1, dest_id));
+}
 
+ContactMultigraph::ContactMultigraph(const std::vector<Contact> &contact_plan)
+    : updates(0), num_rebuilds(0), search_min_contacts(32), window_start(std::numeric_limits<int>::min()),
+      num_expired(0), num_removed(0)
+{
+    build(contact_plan, std::vector<PeriodicContact>(), std::vector<nodeId_t>());
 }
 
-/*
- * Helper functions
- */
-template <typename T>
-bool vector_contains(std::vector<T> vec, T ele) {
-    typename std::vector<T>::iterator it = std::find(vec.begin(), vec.end(), ele);
-    return it != std::end(vec);
+ContactMultigraph::ContactMultigraph(const std::vector<Contact> &contact_plan,
+                                     const std::vector<PeriodicContact> &periodic_contacts)
+    : updates(0), num_rebuilds(0), search_min_contacts(32), window_start(std::numeric_limits<int>::min()),
+      num_expired(0), num_removed(0)
+{
+    build(contact_plan, periodic_contacts, std::vector<nodeId_t>());
 }
 
-// Throw this exception in methods that would otherwise try to access an empty container
-// E.g. calling std::vector::back() on an empty vector is undefined behavior.
-// Following the approach of the Python version CGR library, we use this class for Route::eligible()
-// as a substitue for Python's IndexError
-const char* EmptyContainerError::what() const throw() {
-    return "Tried to access element of an empty container";
+ContactMultigraph::ContactMultigraph(const std::string &binary_filename)
+    : updates(0), num_rebuilds(0), search_min_contacts(NO_INDEX), window_start(std::numeric_limits<int>::min()),
+      num_expired(0), num_removed(0)
+{
+    map(binary_filename);
 }
 
-std::ostream& operator<<(std::ostream &out, const std::vector<Contact> &obj) {
-    out << "[";
-    for (int i = 0; i < obj.size()-1; i++) {
-        out << obj[i] << ", ";
+void ContactMultigraph::build(const std::vector<Contact> &contact_plan, const std::vector<PeriodicContact> &periodic_contacts,
+                              const std::vector<nodeId_t> &extra_nodes) {
+    Storage &s = storage;
+    Periodic &p = periodic;
+    p = Periodic();
+
+    // Node dictionary: every endpoint in the plan gets a dense index, in increasing id order
+    s.node_ids = extra_nodes;
+    s.node_ids.reserve(s.node_ids.size() + 2 * (contact_plan.size() + periodic_contacts.size()));
+    for (const Contact &contact : contact_plan) {
+        s.node_ids.push_back(contact.frm);
+        s.node_ids.push_back(contact.to);
+    }
+    for (const PeriodicContact &periodic_contact : periodic_contacts) {
+        s.node_ids.push_back(periodic_contact.contact.frm);
+        s.node_ids.push_back(periodic_contact.contact.to);
+    }
+    std::sort(s.node_ids.begin(), s.node_ids.end());
+    s.node_ids.erase(std::unique(s.node_ids.begin(), s.node_ids.end()), s.node_ids.end());
+
+    // Order the contacts by (from, to, start time) so that every pair's contacts are contiguous.
+    // Entries [0, n) are the stored contacts and [n, n + num_periodic) the periodic contacts.
+    // The sort's working arrays share one scratch allocation.
+    const uint32_t n = contact_plan.size();
+    const uint32_t num_entries = n + periodic_contacts.size();
+    Arena scratch(num_entries * (sizeof(const Contact*) + 3 * sizeof(uint32_t)) + 4 * alignof(std::max_align_t));
+    ArenaVector<const Contact*> entry(num_entries, NULL, scratch);
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        entry[i] = i < n ? &contact_plan[i] : &periodic_contacts[i - n].contact;
+    }
+    ArenaVector<uint32_t> frm_index(num_entries, 0, scratch), to_index(num_entries, 0, scratch);
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        frm_index[i] = std::lower_bound(s.node_ids.begin(), s.node_ids.end(), entry[i]->frm) - s.node_ids.begin();
+        to_index[i] = std::lower_bound(s.node_ids.begin(), s.node_ids.end(), entry[i]->to) - s.node_ids.begin();
+    }
+    ArenaVector<uint32_t> order(num_entries, 0, scratch);
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (frm_index[a] != frm_index[b]) return frm_index[a] < frm_index[b];
+        if (to_index[a] != to_index[b]) return to_index[a] < to_index[b];
+        if (entry[a]->start != entry[b]->start) return entry[a]->start < entry[b]->start;
+        return entry[a]->end < entry[b]->end;
+    });
+
+    // Lay out the contacts and the CSR offsets in a single pass over the sorted contacts
+    s.adj_offsets = std::vector<uint32_t>(s.node_ids.size() + 1, 0);
+    s.start.reserve(n);
+    s.end.reserve(n);
+    s.owlt.reserve(n);
+    s.rate.reserve(n);
+    s.id.reserve(n);
+    s.confidence.reserve(n);
+    s.plan_index.reserve(n);
+    uint64_t num_occurrences = 0;
+    uint32_t prev_frm = NO_INDEX, prev_to = NO_INDEX;
+    for (uint32_t i : order) {
+        if (frm_index[i] != prev_frm || to_index[i] != prev_to) {
+            // first contact of a new pair
+            s.pair_frm.push_back(frm_index[i]);
+            s.pair_to.push_back(to_index[i]);
+            s.pair_offsets.push_back(s.start.size());
+            p.offsets.push_back(p.start.size());
+            ++s.adj_offsets[frm_index[i] + 1];
+            prev_frm = frm_index[i];
+            prev_to = to_index[i];
+        }
+        const Contact &contact = *entry[i];
+        if (i >= n) {
+            const PeriodicContact &periodic_contact = periodic_contacts[i - n];
+            p.pair.push_back(s.pair_frm.size() - 1);
+            p.first.push_back(num_occurrences);
+            p.start.push_back(contact.start);
+            p.end.push_back(contact.end);
+            p.owlt.push_back(contact.owlt);
+            p.rate.push_back(contact.rate);
+            p.id.push_back(contact.id);
+            p.period.push_back(periodic_contact.period);
+            p.confidence.push_back(contact.confidence);
+            // count and period are public, so the constructor's checks are repeated here
+            if (periodic_contact.count < 1 || periodic_contact.period <= 0
+                || periodic_contact.last_end() > std::numeric_limits<int>::max()) {
+                throw std::invalid_argument("invalid periodic contact");
+            }
+            num_occurrences += periodic_contact.count;
+            continue;
+        }
+        s.start.push_back(contact.start);
+        s.end.push_back(contact.end);
+        s.owlt.push_back(contact.owlt);
+        s.rate.push_back(contact.rate);
+        s.id.push_back(contact.id);
+        s.confidence.push_back(contact.confidence);
+        s.plan_index.push_back(i);
+    }
+    // occurrence numbers must leave the OCCURRENCE bit and NO_INDEX free
+    if (num_occurrences >= OCCURRENCE - 1) {
+        throw std::invalid_argument("too many occurrences of periodic contacts");
+    }
+    p.first.push_back(num_occurrences);
+    s.pair_offsets.push_back(s.start.size());
+    p.offsets.push_back(p.start.size());
+    for (uint32_t v = 0; v < s.node_ids.size(); ++v) {
+        s.adj_offsets[v + 1] += s.adj_offsets[v];
     }
-    out << obj[obj.size()-1] << "]";
 
-    return out;
+    attach();
+    build_envelopes();
+    attach();
+    build_search_index(search_min_contacts);
 }
 
-std::ostream& operator<<(std::ostream &out, const Contact &obj) {
-    static const boost::format fmtTemplate("%d->%d(%d-%d,d%d)[mav%.0f%%]");
-    boost::format fmt(fmtTemplate);
-
-    int min_vol = *std::min_element(obj.mav.begin(), obj.mav.end());
-    double volume = 100.0 * min_vol / obj.volume;
-    fmt % obj.frm % obj.to % obj.start % obj.end % obj.owlt % volume;
-    const std::string message(std::move(fmt.str()));
-
-    out << message;
-    return out;
+void ContactMultigraph::attach() {
+    const Storage &s = storage;
+    node_ids = ArrayView<nodeId_t>(s.node_ids);
+    adj_offsets = ArrayView<uint32_t>(s.adj_offsets);
+    pair_frm = ArrayView<uint32_t>(s.pair_frm);
+    pair_to = ArrayView<uint32_t>(s.pair_to);
+    pair_offsets = ArrayView<uint32_t>(s.pair_offsets);
+    start = ArrayView<int>(s.start);
+    end = ArrayView<int>(s.end);
+    owlt = ArrayView<int>(s.owlt);
+    rate = ArrayView<int>(s.rate);
+    id = ArrayView<int>(s.id);
+    confidence = ArrayView<float>(s.confidence);
+    plan_index = ArrayView<uint32_t>(s.plan_index);
+    envelope_offsets = ArrayView<uint32_t>(s.envelope_offsets);
+    envelope_contact = ArrayView<uint32_t>(s.envelope_contact);
+    envelope_bound = ArrayView<int>(s.envelope_bound);
+    longest_contact = ArrayView<int>(s.longest_contact);
 }
 
-std::ostream& operator<<(std::ostream &out, const Route &obj) {
-    static const boost::format fmtTemplate("to:%d|via:%d(%03d,%03d)|bdt:%d|hops:%d|vol:%d|conf:%.1f|%s");
-    boost::format fmt(fmtTemplate);
+uint32_t ContactMultigraph::num_vertices() const {
+    return node_ids.size();
+}
 
-    std::vector<Contact> routeHops = static_cast<Route>(obj).get_hops();
+uint32_t ContactMultigraph::num_contacts() const {
+    return start.size();
+}
 
-    fmt % obj.to_node % obj.next_node % obj.from_time % obj.to_time % obj.best_delivery_time
-        % routeHops.size() % obj.volume % obj.confidence % routeHops;
-    const std::string message(std::move(fmt.str()));
+uint32_t ContactMultigraph::num_periodic_contacts() const {
+    return periodic.start.size();
+}
 
-    out << message;
-    return out;
+uint32_t ContactMultigraph::vertex_index(nodeId_t id) const {
+    const nodeId_t *it = std::lower_bound(node_ids.begin(), node_ids.end(), id);
+    return (it == node_ids.end() || *it != id) ? NO_INDEX : it - node_ids.begin();
 }
 
+uint32_t ContactMultigraph::contact_pair(uint32_t contact) const {
+    if (contact & OCCURRENCE) {
+        int i;
+        return periodic.pair[occurrence_of(contact, i)];
+    }
+    const uint32_t base_contacts = pair_offsets[pair_offsets.size() - 1];
+    if (contact >= base_contacts) {
+        return added_pair[contact - base_contacts];
+    }
+    return std::upper_bound(pair_offsets.begin(), pair_offsets.end(), contact) - pair_offsets.begin() - 1;
+}
 
+uint32_t ContactMultigraph::pair_size(uint32_t pair) const {
+    if (!pair_updated.empty() && pair_updated[pair]) {
+        return pair_lists[pair].size();
+    }
+    return pair_offsets[pair + 1] - pair_offsets[pair];
+}
 
-/*
- * Returns the contact C in sorted vector of Contacts `contacts` with the smallest end time
- * where C.end >= arrival_time && C.start <= arrival_time.
- * Assumes non-overlapping intervals.
- */
-Contact contact_search(std::vector<Contact> &contacts, int arrival_time) {
-    int index = contact_search_index(contacts, arrival_time);
-    return contacts[index];
+uint32_t ContactMultigraph::pair_contact(uint32_t pair, uint32_t i) const {
+    if (!pair_updated.empty() && pair_updated[pair]) {
+        return pair_lists[pair][i];
+    }
+    return pair_offsets[pair] + i;
 }
 
-/* 
- * Returns the index of the contact C in sorted vector of Contacts `contacts` with the smallest end time
- * where C.end >= arrival_time && C.start <= arrival_time.
- * Assumes non-overlapping intervals.
- */
-int contact_search_index(std::vector<Contact> &contacts, int arrival_time) {
-    int left = 0;
-    int right = contacts.size() - 1;
-    if (contacts[left].end > arrival_time) {
-        return left;
-    }
-    int mid;
-    while (left < right - 1) {
-        mid = (left + right) / 2;
-        if (contacts[mid].end > arrival_time) {
-            right = mid;
+uint32_t ContactMultigraph::find_position(const Contact &contact, uint32_t &pair) const {
+    pair = NO_INDEX;
+    const uint32_t frm = vertex_index(contact.frm);
+    const uint32_t to = vertex_index(contact.to);
+    if (NO_INDEX == frm || NO_INDEX == to) {
+        return NO_INDEX;
+    }
+    // the pairs leaving a vertex are sorted by destination vertex
+    const uint32_t *first_pair = pair_to.begin() + adj_offsets[frm];
+    const uint32_t *last_pair = pair_to.begin() + adj_offsets[frm + 1];
+    const uint32_t *it = std::lower_bound(first_pair, last_pair, to);
+    if (it == last_pair || *it != to) {
+        return NO_INDEX;
+    }
+    pair = it - pair_to.begin();
+    // the contacts of a pair are sorted by start time
+    const uint32_t size = pair_size(pair);
+    uint32_t lo = 0, hi = size;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (start[pair_contact(pair, mid)] < contact.start) {
+            lo = mid + 1;
         }
         else {
-            left = mid;
+            hi = mid;
+        }
+    }
+    for (; lo < size && start[pair_contact(pair, lo)] == contact.start; ++lo) {
+        if (end[pair_contact(pair, lo)] == contact.end) {
+            return lo;
         }
     }
-    return right;
+    return NO_INDEX;
 }
 
-/*
- * Multigraph routing route-finding algorithm. Finds the shortest (least amount of time) path
- * to transfer data throughout a network of nodes connected by temporary contacts.
- * root_contact is a contact from the source node to the source node, and it's start time is when data first arrives to the source node
- * destination is the nodeID_t of the destination node
- * contact_plan is a vector of contacts that is used to construct the contact multigraph
- */
-Route cmr_dijkstra(Contact* root_contact, nodeId_t destination, std::vector<Contact> contact_plan) {
-    // Construct Contact Multigraph from Contact Plan
-    ContactMultigraph CM(contact_plan, destination);
-    // Default construction for each vertex sets arrival time to infinity,
-    // visited to false, predecessor to null.
-    // The source vertex's arrival time needs to be set to the start time given by the root contact.
-    CM.vertices[root_contact->frm]->arrival_time = root_contact->start;
-    
-
-    
-    // Construct min PQ of vertices ordered by arrival time
-    std::priority_queue<Vertex*, std::vector<Vertex*>, CompareArrivals> PQ;
-    for (auto v : CM.vertices) {
-        PQ.push(v.second);
-    }
-    Vertex* v_curr;
-    Vertex* v_next;
-    // The root vertex will be the top of the priority queue
-    v_curr = PQ.top();
-    PQ.pop();
-    while (true) {
-        // ------------- Multigraph Review Procedure start -------------
-        for (auto adj : v_curr->adjacencies) {
-            Vertex* u = CM.vertices[adj.first];
-            if (u->visited) {
-                continue;
-            }
-            // If the latest contact leaving v_curr is closed by the time data gets to v_curr,
-            // there are no valid contacts.
-            std::vector<Contact> v_curr_to_u = v_curr->adjacencies[u->id];
-            if (v_curr_to_u.back().end < v_curr->arrival_time) {
-                continue;
-            }
-            // find earliest usable contact from v_curr to u
-            Contact best_contact = contact_search(v_curr_to_u, v_curr->arrival_time);
-            // owlt_mgn is used in the CMR algorithm, but is not part of this implementation because it was not used in CGR
-            // best_arr_time is the best time u can be reached by taking a contact from v_curr. if this is the fastest known route
-            // then update u's arrival time and predecessor
-            int best_arr_time = std::max(best_contact.start, v_curr->arrival_time) + best_contact.owlt;
-            if (best_arr_time < u->arrival_time) {
-                u->arrival_time = best_arr_time;
-                // update u's priority in PQ using "lazy deletion"
-                // Source: https://stackoverflow.com/questions/9209323/easiest-way-of-using-min-priority-queue-with-key-update-in-c
-                PQ.push(u);
-                u->predecessor = &best_contact;
-            }
+uint32_t ContactMultigraph::find_contact(const Contact &contact) const {
+    uint32_t pair;
+    const uint32_t position = find_position(contact, pair);
+    if (NO_INDEX != position) {
+        return pair_contact(pair, position);
+    }
+    if (NO_INDEX == pair || periodic.offsets.empty()) {
+        return NO_INDEX;
+    }
+    const Periodic &p = periodic;
+    for (uint32_t d = p.offsets[pair]; d < p.offsets[pair + 1]; ++d) {
+        const int64_t shift = static_cast<int64_t>(contact.start) - p.start[d];
+        if (shift < 0 || shift % p.period[d] != 0 || contact.end - contact.start != p.end[d] - p.start[d]) {
+            continue;
         }
-        v_curr->visited = true;
-        // ------------- Multigraph Review Procedure end -------------
-        // get the next closest vertex to do MRP with
-        v_next = PQ.top();
+        if (shift / p.period[d] < p.first[d + 1] - p.first[d]) {
+            return OCCURRENCE | static_cast<uint32_t>(p.first[d] + shift / p.period[d]);
+        }
+    }
+    return NO_INDEX;
+}
+
+Contact ContactMultigraph::contact(uint32_t c) const {
+    const uint32_t pair = contact_pair(c);
+    if (c & OCCURRENCE) {
+        int i;
+        const uint32_t d = occurrence_of(c, i);
+        Contact contact(node_ids[pair_frm[pair]], node_ids[pair_to[pair]], contact_start(c), contact_end(c),
+                        periodic.rate[d], periodic.confidence[d], periodic.owlt[d]);
+        contact.id = periodic.id[d];
+        return contact;
+    }
+    Contact contact(node_ids[pair_frm[pair]], node_ids[pair_to[pair]], start[c], end[c], rate[c], confidence[c], owlt[c]);
+    contact.id = id[c];
+    return contact;
+}
+
+uint32_t ContactMultigraph::occurrence_of(uint32_t contact, int &i) const {
+    const uint32_t n = contact & ~OCCURRENCE;
+    const uint32_t d = std::upper_bound(periodic.first.begin(), periodic.first.end(), n) - periodic.first.begin() - 1;
+    i = n - periodic.first[d];
+    return d;
+}
+
+int ContactMultigraph::contact_start(uint32_t contact) const {
+    if (contact & OCCURRENCE) {
+        int i;
+        const uint32_t d = occurrence_of(contact, i);
+        return periodic.start[d] + i * periodic.period[d];
+    }
+    return start[contact];
+}
+
+int ContactMultigraph::contact_end(uint32_t contact) const {
+    if (contact & OCCURRENCE) {
+        int i;
+        const uint32_t d = occurrence_of(contact, i);
+        return periodic.end[d] + i * periodic.period[d];
+    }
+    return end[contact];
+}
+
+int ContactMultigraph::contact_owlt(uint32_t contact) const {
+    if (contact & OCCURRENCE) {
+        int i;
+        return periodic.owlt[occurrence_of(contact, i)];
+    }
+    return owlt[contact];
+}
+
+uint32_t ContactMultigraph::earliest_occurrence(uint32_t pair, int time, uint32_t found) const {
+    if (periodic.offsets.empty() || periodic.offsets[pair] == periodic.offsets[pair + 1]) {
+        return found;
+    }
+    const Periodic &p = periodic;
+    int64_t found_arrival = std::numeric_limits<int64_t>::max(), found_start = found_arrival;
+    if (NO_INDEX != found) {
+        found_start = start[found];
+        found_arrival = std::max<int64_t>(start[found], time) + owlt[found];
+    }
+    for (uint32_t d = p.offsets[pair]; d < p.offsets[pair + 1]; ++d) {
+        // The occurrences of a periodic contact share their owlt and do not overlap, so the
+        // first one i that ends after time, at end + i * period, arrives earliest.
+        const int64_t i = time < p.end[d] ? 0 : (static_cast<int64_t>(time) - p.end[d]) / p.period[d] + 1;
+        if (i >= p.first[d + 1] - p.first[d]) {
+            continue;
+        }
+        const int64_t occurrence_start = p.start[d] + i * p.period[d];
+        const int64_t arrival = std::max<int64_t>(occurrence_start, time) + p.owlt[d];
+        if (arrival < found_arrival || (arrival == found_arrival && occurrence_start < found_start)) {
+            found = OCCURRENCE | static_cast<uint32_t>(p.first[d] + i);
+            found_start = occurrence_start;
+            found_arrival = arrival;
+        }
+    }
+    return found;
+}
+
+Route ContactMultigraph::make_route(ArrayView<uint32_t> contacts) const {
+    Route route(contact(contacts[0]));
+    for (uint32_t i = 1; i < contacts.size(); ++i) {
+        route.append(contact(contacts[i]));
+    }
+    return route;
+}
+
+void ContactMultigraph::pair_envelope(uint32_t pair, Arena &scratch, std::vector<EnvelopeSegment> &segments) const {
+    segments.clear();
+    const uint32_t n = pair_size(pair);
+    if (0 == n) {
+        return;
+    }
+    // Contacts are compared by arrival, then start time, then position in the pair. Data ready
+    // at t either takes an open contact, arriving at t + owlt, or waits for one that starts
+    // later, arriving at start + owlt. waiting[i] is the best of the contacts from position i
+    // on to wait for.
+    ArenaVector<uint32_t> contacts(n, 0, scratch), waiting(n + 1, NO_INDEX, scratch);
+    ArenaVector<int> ends(n, 0, scratch);
+    for (uint32_t i = 0; i < n; ++i) {
+        contacts[i] = pair_contact(pair, i);
+        ends[i] = end[contacts[i]];
+    }
+    std::sort(ends.begin(), ends.end());
+    for (uint32_t i = n; i-- > 0; ) {
+        const uint32_t c = contacts[i], best = waiting[i + 1];
+        const bool earlier = NO_INDEX == best
+            || static_cast<int64_t>(start[c]) + owlt[c] <= static_cast<int64_t>(start[contacts[best]]) + owlt[contacts[best]];
+        waiting[i] = earlier ? i : best;
+    }
+    // open contacts as a heap of positions, the smallest owlt on top
+    ArenaVector<uint32_t> open(scratch);
+    open.reserve(n);
+    auto later = [&](uint32_t a, uint32_t b) {
+        const uint32_t ca = contacts[a], cb = contacts[b];
+        if (owlt[ca] != owlt[cb]) return owlt[ca] > owlt[cb];
+        if (start[ca] != start[cb]) return start[ca] > start[cb];
+        return a > b;
+    };
+    // appends the piece of the envelope up to bound, if it is not empty
+    auto add = [&](int bound, uint32_t position) {
+        const uint32_t contact = contacts[position];
+        if (!segments.empty() && segments.back().bound >= bound) {
+            return;
+        }
+        if (!segments.empty() && segments.back().contact == contact) {
+            segments.back().bound = bound;
+        } else {
+            segments.push_back({ bound, contact });
+        }
+    };
+
+    // Between two consecutive start or end times the open contacts and those to wait for stay
+    // the same, and the best open one wins up to the time it would arrive after the best one
+    // to wait for.
+    uint32_t next_start = 0, next_end = 0;
+    int time = start[contacts[0]];
+    add(time, waiting[0]);
+    while (next_end < n) {
+        while (next_start < n && start[contacts[next_start]] <= time) {
+            open.push_back(next_start++);
+            std::push_heap(open.begin(), open.end(), later);
+        }
+        while (!open.empty() && end[contacts[open.front()]] <= time) {
+            std::pop_heap(open.begin(), open.end(), later);
+            open.pop_back();
+        }
+        while (next_end < n && ends[next_end] <= time) {
+            ++next_end;
+        }
+        if (next_end == n) {
+            break;
+        }
+        const int next_time = next_start < n ? std::min(start[contacts[next_start]], ends[next_end]) : ends[next_end];
+        const uint32_t wait = waiting[next_start];
+        if (open.empty()) {
+            add(next_time, wait);
+        } else if (NO_INDEX == wait) {
+            add(next_time, open.front());
+        } else {
+            const uint32_t c = contacts[wait];
+            const int64_t switch_time = static_cast<int64_t>(start[c]) + owlt[c] - owlt[contacts[open.front()]] + 1;
+            if (switch_time > time) {
+                add(static_cast<int>(std::min<int64_t>(switch_time, next_time)), open.front());
+            }
+            if (switch_time < next_time) {
+                add(next_time, wait);
+            }
+        }
+        time = next_time;
+    }
+}
+
+void ContactMultigraph::build_envelopes() {
+    const uint32_t num_pairs = pair_frm.size();
+    Storage &s = storage;
+    s.envelope_offsets.assign(1, 0);
+    s.envelope_offsets.reserve(num_pairs + 1);
+    s.envelope_bound.clear();
+    s.envelope_contact.clear();
+    s.longest_contact.assign(num_pairs, 0);
+    Arena scratch;
+    std::vector<EnvelopeSegment> segments;
+    for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+        scratch.reset();
+        pair_envelope(pair, scratch, segments);
+        // a pair whose every contact is the best one up to its end needs no envelope of its own
+        bool own_envelope = segments.size() == pair_offsets[pair + 1] - pair_offsets[pair];
+        for (uint32_t i = 0; own_envelope && i < segments.size(); ++i) {
+            own_envelope = segments[i].contact == pair_offsets[pair] + i && segments[i].bound == end[pair_offsets[pair] + i];
+        }
+        if (!own_envelope) {
+            for (const EnvelopeSegment &segment : segments) {
+                s.envelope_bound.push_back(segment.bound);
+                s.envelope_contact.push_back(segment.contact);
+            }
+        }
+        s.envelope_offsets.push_back(s.envelope_bound.size());
+        for (uint32_t c = pair_offsets[pair]; c < pair_offsets[pair + 1]; ++c) {
+            s.longest_contact[pair] = std::max(s.longest_contact[pair], end[c] - start[c]);
+        }
+    }
+}
+
+int ContactMultigraph::pair_longest(uint32_t pair) const {
+    if (!pair_updated.empty() && pair_updated[pair]) {
+        return updated_longest[pair];
+    }
+    return longest_contact[pair];
+}
+
+uint32_t ContactMultigraph::contact_search(uint32_t pair, int arrival_time) const {
+    // the envelope segment that arrival_time falls in
+    uint32_t found;
+    if (!pair_updated.empty() && pair_updated[pair]) {
+        const std::vector<EnvelopeSegment> &segments = pair_envelopes[pair];
+        const uint32_t first = segment_first.empty() ? 0 : segment_first[pair];
+        std::vector<EnvelopeSegment>::const_iterator it = std::upper_bound(segments.begin() + first, segments.end(), arrival_time,
+            [](int time, const EnvelopeSegment &segment) { return time < segment.bound; });
+        found = it == segments.end() ? NO_INDEX : it->contact;
+    }
+    else {
+        const uint32_t position = search_position(pair, arrival_time);
+        const uint32_t first_segment = envelope_offsets[pair];
+        if (first_segment != envelope_offsets[pair + 1]) {
+            found = first_segment + position < envelope_offsets[pair + 1] ? envelope_contact[first_segment + position] : NO_INDEX;
+        }
+        else {
+            found = pair_offsets[pair] + position < pair_offsets[pair + 1] ? pair_offsets[pair] + position : NO_INDEX;
+        }
+    }
+    return earliest_occurrence(pair, arrival_time, found);
+}
+
+uint32_t ContactMultigraph::contact_search(uint32_t pair, int arrival_time, const std::vector<uint32_t> &excluded) const {
+    const uint32_t found = contact_search(pair, arrival_time);
+    if (NO_INDEX == found || excluded.empty() || !std::binary_search(excluded.begin(), excluded.end(), found)) {
+        return found;
+    }
+    // A contact open at arrival_time started at most the pair's longest duration before it,
+    // and data never arrives before the contact it takes starts, so the pair's contacts in
+    // start order are compared from the first that could be open up to the first that starts
+    // at or after the best arrival so far.
+    const int64_t earliest_start = static_cast<int64_t>(arrival_time) - pair_longest(pair);
+    uint32_t lo = pair_first.empty() ? 0 : pair_first[pair], hi = pair_size(pair);
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (start[pair_contact(pair, mid)] < earliest_start) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    uint32_t best = NO_INDEX;
+    int64_t best_arrival = std::numeric_limits<int64_t>::max();
+    for (uint32_t i = lo; i < pair_size(pair); ++i) {
+        const uint32_t c = pair_contact(pair, i);
+        if (start[c] >= best_arrival) {
+            break;
+        }
+        const int64_t arrival = std::max<int64_t>(start[c], arrival_time) + owlt[c];
+        if (end[c] > arrival_time && arrival < best_arrival && !std::binary_search(excluded.begin(), excluded.end(), c)) {
+            best = c;
+            best_arrival = arrival;
+        }
+    }
+    // the first occurrence of each periodic contact that ends after arrival_time and is not excluded
+    const Periodic &p = periodic;
+    for (uint32_t d = p.offsets.empty() ? 0 : p.offsets[pair]; !p.offsets.empty() && d < p.offsets[pair + 1]; ++d) {
+        int64_t i = arrival_time < p.end[d] ? 0 : (static_cast<int64_t>(arrival_time) - p.end[d]) / p.period[d] + 1;
+        while (i < p.first[d + 1] - p.first[d]
+               && std::binary_search(excluded.begin(), excluded.end(), OCCURRENCE | static_cast<uint32_t>(p.first[d] + i))) {
+            ++i;
+        }
+        if (i >= p.first[d + 1] - p.first[d]) {
+            continue;
+        }
+        const int64_t occurrence_start = p.start[d] + i * p.period[d];
+        const int64_t arrival = std::max<int64_t>(occurrence_start, arrival_time) + p.owlt[d];
+        if (arrival < best_arrival || (arrival == best_arrival && occurrence_start < contact_start(best))) {
+            best = OCCURRENCE | static_cast<uint32_t>(p.first[d] + i);
+            best_arrival = arrival;
+        }
+    }
+    return best;
+}
+
+const int* ContactMultigraph::pair_bounds(uint32_t pair, uint32_t &size) const {
+    if (envelope_offsets[pair] != envelope_offsets[pair + 1]) {
+        size = envelope_offsets[pair + 1] - envelope_offsets[pair];
+        return envelope_bound.begin() + envelope_offsets[pair];
+    }
+    size = pair_offsets[pair + 1] - pair_offsets[pair];
+    return end.begin() + pair_offsets[pair];
+}
+
+uint32_t ContactMultigraph::search_position(uint32_t pair, int time) const {
+    uint32_t lo = 0, hi;
+    const int *ends = pair_bounds(pair, hi);
+    if (!search_offsets.empty() && search_offsets[pair] != search_offsets[pair + 1]) {
+        // narrow the search to the bucket containing time
+        const uint32_t *buckets = search_buckets.data() + search_offsets[pair];
+        const uint32_t last_bucket = search_offsets[pair + 1] - search_offsets[pair] - 1;
+        const int64_t offset = static_cast<int64_t>(time) - search_origin[pair];
+        if (offset < 0) {
+            hi = buckets[0];
+        }
+        else if ((offset >> search_shift[pair]) >= last_bucket) {
+            lo = buckets[last_bucket];
+        }
+        else {
+            lo = buckets[offset >> search_shift[pair]];
+            hi = buckets[(offset >> search_shift[pair]) + 1];
+        }
+    }
+    // segments that expired from the time window are skipped
+    if (!segment_first.empty()) {
+        lo = std::max(lo, segment_first[pair]);
+        hi = std::max(hi, lo);
+    }
+    return std::upper_bound(ends + lo, ends + hi, time) - ends;
+}
+
+void ContactMultigraph::fill_search_buckets(uint32_t pair) {
+    uint32_t size;
+    const int *ends = pair_bounds(pair, size);
+    uint32_t position = 0;
+    for (uint32_t b = search_offsets[pair]; b < search_offsets[pair + 1]; ++b) {
+        const int64_t bucket_start = search_origin[pair] + (static_cast<int64_t>(b - search_offsets[pair]) << search_shift[pair]);
+        while (position < size && ends[position] <= bucket_start) {
+            ++position;
+        }
+        search_buckets[b] = position;
+    }
+}
+
+void ContactMultigraph::build_search_index(uint32_t min_contacts) {
+    search_min_contacts = min_contacts;
+    search_offsets.clear();
+    search_buckets.clear();
+    search_origin.clear();
+    search_shift.clear();
+    if (NO_INDEX == min_contacts) {
+        return;
+    }
+    const uint32_t num_pairs = pair_frm.size();
+    search_offsets.reserve(num_pairs + 1);
+    search_origin.assign(num_pairs, 0);
+    search_shift.assign(num_pairs, 0);
+    for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+        search_offsets.push_back(search_buckets.size());
+        uint32_t size;
+        const int *ends = pair_bounds(pair, size);
+        if (size < std::max<uint32_t>(min_contacts, 1)) {
+            continue;
+        }
+        // power of two bucket width giving about four bounds per bucket
+        const int first_end = ends[0];
+        const int64_t span = static_cast<int64_t>(ends[size - 1]) - first_end + 1;
+        const int64_t width = std::max<int64_t>(1, (4 * span + size - 1) / size);
+        uint8_t shift = 0;
+        while ((int64_t(1) << shift) < width) {
+            ++shift;
+        }
+        search_origin[pair] = first_end;
+        search_shift[pair] = shift;
+        search_buckets.resize(search_buckets.size() + ((span - 1) >> shift) + 2);
+    }
+    search_offsets.push_back(search_buckets.size());
+    for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+        fill_search_buckets(pair);
+    }
+}
+
+void ContactMultigraph::advance(int now) {
+    if (now <= window_start) {
+        return;
+    }
+    window_start = now;
+    if (pair_first.empty()) {
+        const uint32_t num_pairs = pair_frm.size();
+        pair_first.assign(num_pairs, 0);
+        segment_first.assign(num_pairs, 0);
+        expiry_time.assign(num_pairs, std::numeric_limits<int>::max());
+        expiry.clear();
+        expiry.reserve(num_pairs);
+        num_expired = 0;
+        for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+            expire_pair(pair);
+        }
+    }
+    // only the pairs whose next contact or segment has expired are visited
+    while (!expiry.empty() && expiry.front().first <= now) {
+        const std::pair<int, uint32_t> next = expiry.front();
+        std::pop_heap(expiry.begin(), expiry.end(), std::greater<std::pair<int, uint32_t>>());
+        expiry.pop_back();
+        if (next.first == expiry_time[next.second]) {
+            expire_pair(next.second);
+        }
+    }
+    // expired contacts and contacts removed by updates are still in the columns
+    const uint32_t live = num_contacts() - num_removed - num_expired;
+    if (num_contacts() - live > live) {
+        rebuild(NULL);
+        ++updates;
+    }
+}
+
+void ContactMultigraph::expire_pair(uint32_t pair) {
+    // Contacts of a pair may overlap, so one that expired behind a live one is only skipped
+    // once the contacts before it have expired too; until then it counts as live.
+    const uint32_t size = pair_size(pair);
+    uint32_t &first = pair_first[pair];
+    num_expired -= first;
+    while (first < size && end[pair_contact(pair, first)] <= window_start) {
+        ++first;
+    }
+    num_expired += first;
+    // the envelope's bounds increase, so its expired segments are a prefix too
+    uint32_t num_segments;
+    const int *bounds = NULL;
+    const bool updated = !pair_updated.empty() && pair_updated[pair];
+    if (updated) {
+        num_segments = pair_envelopes[pair].size();
+    }
+    else {
+        bounds = pair_bounds(pair, num_segments);
+    }
+    uint32_t &segment = segment_first[pair];
+    while (segment < num_segments && (updated ? pair_envelopes[pair][segment].bound : bounds[segment]) <= window_start) {
+        ++segment;
+    }
+    int next = std::numeric_limits<int>::max();
+    if (first < size) {
+        next = end[pair_contact(pair, first)];
+    }
+    if (segment < num_segments) {
+        next = std::min(next, updated ? pair_envelopes[pair][segment].bound : bounds[segment]);
+    }
+    expiry_time[pair] = next;
+    if (std::numeric_limits<int>::max() != next) {
+        expiry.push_back(std::make_pair(next, pair));
+        std::push_heap(expiry.begin(), expiry.end(), std::greater<std::pair<int, uint32_t>>());
+    }
+}
+
+int ContactMultigraph::now() const {
+    return window_start;
+}
+
+uint64_t ContactMultigraph::version() const {
+    return updates;
+}
+
+uint64_t ContactMultigraph::rebuilds() const {
+    return num_rebuilds;
+}
+
+void ContactMultigraph::own() {
+    if (NULL == mapping) {
+        return;
+    }
+    Storage &s = storage;
+    s.node_ids.assign(node_ids.begin(), node_ids.end());
+    s.adj_offsets.assign(adj_offsets.begin(), adj_offsets.end());
+    s.pair_frm.assign(pair_frm.begin(), pair_frm.end());
+    s.pair_to.assign(pair_to.begin(), pair_to.end());
+    s.pair_offsets.assign(pair_offsets.begin(), pair_offsets.end());
+    s.start.assign(start.begin(), start.end());
+    s.end.assign(end.begin(), end.end());
+    s.owlt.assign(owlt.begin(), owlt.end());
+    s.rate.assign(rate.begin(), rate.end());
+    s.id.assign(id.begin(), id.end());
+    s.confidence.assign(confidence.begin(), confidence.end());
+    s.plan_index.assign(plan_index.begin(), plan_index.end());
+    s.envelope_offsets.assign(envelope_offsets.begin(), envelope_offsets.end());
+    s.envelope_contact.assign(envelope_contact.begin(), envelope_contact.end());
+    s.envelope_bound.assign(envelope_bound.begin(), envelope_bound.end());
+    s.longest_contact.assign(longest_contact.begin(), longest_contact.end());
+    attach();
+    mapping.reset();
+}
+
+std::vector<uint32_t>& ContactMultigraph::update_pair(uint32_t pair) {
+    if (pair_updated.empty()) {
+        pair_lists.resize(pair_frm.size());
+        pair_envelopes.resize(pair_frm.size());
+        updated_longest.assign(pair_frm.size(), 0);
+        pair_updated.assign(pair_frm.size(), false);
+    }
+    if (!pair_updated[pair]) {
+        for (uint32_t c = pair_offsets[pair]; c < pair_offsets[pair + 1]; ++c) {
+            pair_lists[pair].push_back(c);
+        }
+        pair_updated[pair] = true;
+    }
+    return pair_lists[pair];
+}
+
+void ContactMultigraph::refresh_pair(uint32_t pair) {
+    Arena scratch;
+    pair_envelope(pair, scratch, pair_envelopes[pair]);
+    updated_longest[pair] = 0;
+    for (uint32_t i = 0; i < pair_size(pair); ++i) {
+        const uint32_t c = pair_contact(pair, i);
+        updated_longest[pair] = std::max(updated_longest[pair], end[c] - start[c]);
+    }
+    if (pair_first.empty()) {
+        return;
+    }
+    // the pair's contacts and envelope changed, so its window positions are found again
+    num_expired -= pair_first[pair];
+    pair_first[pair] = 0;
+    segment_first[pair] = 0;
+    expire_pair(pair);
+}
+
+void ContactMultigraph::rebuild(const Contact *contact) {
+    std::vector<Contact> contact_plan;
+    std::vector<uint32_t> origin;
+    contact_plan.reserve(num_contacts() + 1);
+    origin.reserve(num_contacts() + 1);
+    for (uint32_t pair = 0; pair < pair_frm.size(); ++pair) {
+        // contacts that expired from the time window are dropped
+        for (uint32_t i = pair_first.empty() ? 0 : pair_first[pair]; i < pair_size(pair); ++i) {
+            const uint32_t c = pair_contact(pair, i);
+            if (end[c] <= window_start) {
+                continue;
+            }
+            contact_plan.push_back(this->contact(c));
+            origin.push_back(plan_index[c]);
+        }
+    }
+    if (NULL != contact) {
+        contact_plan.push_back(*contact);
+        origin.push_back(NO_INDEX);
+    }
+    // periodic contacts keep their occurrences that have not expired from the time window
+    std::vector<PeriodicContact> periodic_contacts;
+    const Periodic &p = periodic;
+    for (uint32_t d = 0; d < p.start.size(); ++d) {
+        const int count = p.first[d + 1] - p.first[d];
+        const int64_t i = window_start < p.end[d] ? 0 : (static_cast<int64_t>(window_start) - p.end[d]) / p.period[d] + 1;
+        if (i < count) {
+            const uint32_t pair = p.pair[d];
+            const int shift = static_cast<int>(i) * p.period[d];
+            Contact first(node_ids[pair_frm[pair]], node_ids[pair_to[pair]], p.start[d] + shift, p.end[d] + shift,
+                          p.rate[d], p.confidence[d], p.owlt[d]);
+            first.id = p.id[d];
+            periodic_contacts.push_back(PeriodicContact(first, p.period[d], count - static_cast<int>(i)));
+        }
+    }
+    // keep vertices without contacts, such as a destination added by the constructor
+    const std::vector<nodeId_t> nodes(node_ids.begin(), node_ids.end());
+
+    storage = Storage();
+    mapping.reset();
+    added_pair.clear();
+    pair_lists.clear();
+    pair_envelopes.clear();
+    updated_longest.clear();
+    pair_updated.clear();
+    pair_first.clear();
+    segment_first.clear();
+    expiry.clear();
+    expiry_time.clear();
+    num_expired = 0;
+    num_removed = 0;
+    build(contact_plan, periodic_contacts, nodes);
+    for (uint32_t &i : storage.plan_index) {
+        i = origin[i];
+    }
+    ++num_rebuilds;
+}
+
+void ContactMultigraph::add_contact(const Contact &contact) {
+    if (contact.start >= contact.end) {
+        throw std::invalid_argument("contact must end after it starts");
+    }
+    own();
+    uint32_t pair;
+    find_position(contact, pair);
+    if (NO_INDEX == pair) {
+        // first contact between these nodes: there is no pair to insert it into
+        rebuild(&contact);
+        ++updates;
+        return;
+    }
+    // contacts stay sorted by start and then end time, as built
+    std::vector<uint32_t> &contacts = update_pair(pair);
+    std::vector<uint32_t>::iterator it = std::lower_bound(contacts.begin(), contacts.end(), contact,
+        [this](uint32_t c, const Contact &added) {
+            return start[c] < added.start || (start[c] == added.start && end[c] < added.end);
+        });
+
+    Storage &s = storage;
+    const uint32_t index = s.start.size();
+    s.start.push_back(contact.start);
+    s.end.push_back(contact.end);
+    s.owlt.push_back(contact.owlt);
+    s.rate.push_back(contact.rate);
+    s.id.push_back(contact.id);
+    s.confidence.push_back(contact.confidence);
+    s.plan_index.push_back(NO_INDEX);
+    added_pair.push_back(pair);
+    attach();
+    contacts.insert(it, index);
+    refresh_pair(pair);
+    ++updates;
+}
+
+bool ContactMultigraph::remove_contact(const Contact &contact) {
+    uint32_t pair;
+    const uint32_t position = find_position(contact, pair);
+    if (NO_INDEX == position) {
+        return false;
+    }
+    own();
+    std::vector<uint32_t> &contacts = update_pair(pair);
+    contacts.erase(contacts.begin() + position);
+    ++num_removed;
+    refresh_pair(pair);
+    ++updates;
+    return true;
+}
+
+bool ContactMultigraph::set_rate(const Contact &contact, int rate) {
+    // only stored contacts have a rate of their own; an occurrence shares its periodic contact's
+    uint32_t pair;
+    const uint32_t position = find_position(contact, pair);
+    if (NO_INDEX == position) {
+        return false;
+    }
+    const uint32_t c = pair_contact(pair, position);
+    own();
+    storage.rate[c] = rate;
+    ++updates;
+    return true;
+}
+
+bool ContactMultigraph::set_end(const Contact &contact, int end) {
+    uint32_t pair;
+    const uint32_t position = find_position(contact, pair);
+    if (NO_INDEX == position) {
+        return false;
+    }
+    const uint32_t c = pair_contact(pair, position);
+    if (end <= start[c]) {
+        throw std::invalid_argument("contact must end after it starts");
+    }
+    own();
+    // the pair's envelope changes, so it moves to an updated list with an envelope of its own
+    update_pair(pair);
+    storage.end[c] = end;
+    refresh_pair(pair);
+    ++updates;
+    return true;
+}
+
+
+/*
+ * Binary contact plan format, version 2. All integers are little-endian.
+ *
+ *   BinaryPlanHeader (160 bytes)
+ *   sections, each starting at the 8-byte aligned offset recorded in the header:
+ *     node_ids      uint64[num_vertices]     sorted node dictionary
+ *     adj_offsets   uint32[num_vertices + 1]
+ *     pair_frm      uint32[num_pairs]
+ *     pair_to       uint32[num_pairs]
+ *     pair_offsets  uint32[num_pairs + 1]
+ *     start, end, owlt, rate, id  int32[num_contacts] each
+ *     confidence    float32[num_contacts]
+ *     plan_index    uint32[num_contacts]
+ *     envelope_offsets  uint32[num_pairs + 1]
+ *     envelope_bound    int32[num_segments]
+ *     envelope_contact  uint32[num_segments]
+ *     longest_contact   int32[num_pairs]
+ *
+ * The sections are the ContactMultigraph arrays, so contacts are already grouped and
+ * sorted per (from, to) pair and the file can be routed over in place.
+ */
+const char BINARY_PLAN_MAGIC[8] = { 'C', 'G', 'R', 'P', 'L', 'A', 'N', '\0' };
+const uint32_t BINARY_PLAN_VERSION = 2;
+const uint32_t BINARY_PLAN_BYTE_ORDER = 0x01020304;
+
+enum BinaryPlanSection {
+    SECTION_NODE_IDS, SECTION_ADJ_OFFSETS, SECTION_PAIR_FRM, SECTION_PAIR_TO, SECTION_PAIR_OFFSETS,
+    SECTION_START, SECTION_END, SECTION_OWLT, SECTION_RATE, SECTION_ID, SECTION_CONFIDENCE,
+    SECTION_PLAN_INDEX, SECTION_ENVELOPE_OFFSETS, SECTION_ENVELOPE_BOUND, SECTION_ENVELOPE_CONTACT,
+    SECTION_LONGEST_CONTACT, NUM_SECTIONS
+};
+
+struct BinaryPlanHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_vertices;
+    uint32_t num_pairs;
+    uint32_t num_contacts;
+    uint32_t num_segments;
+    uint64_t sections[NUM_SECTIONS];
+};
+static_assert(sizeof(BinaryPlanHeader) == 160, "binary contact plan header must be 160 bytes");
+
+// the format is little-endian and mapped in place, so it can only be used on little-endian hosts
+static bool host_is_little_endian() {
+    const uint32_t one = 1;
+    return 1 == *reinterpret_cast<const unsigned char*>(&one);
+}
+
+// Points `view` at section `section` of the mapped file after checking that it fits
+template <typename T>
+static void map_section(ArrayView<T> &view, const MappedFile &file, const BinaryPlanHeader &header,
+                        BinaryPlanSection section, uint64_t count, const std::string &filename) {
+    const uint64_t offset = header.sections[section];
+    if (offset % 8 != 0 || offset > file.size() || count > (file.size() - offset) / sizeof(T)) {
+        throw ContactPlanError("Corrupt binary contact plan " + filename);
+    }
+    view = ArrayView<T>(reinterpret_cast<const T*>(file.data() + offset), count);
+}
+
+void ContactMultigraph::map(const std::string &binary_filename) {
+    if (!host_is_little_endian()) {
+        throw ContactPlanError("Binary contact plans are only supported on little-endian hosts");
+    }
+    mapping = std::make_shared<MappedFile>(binary_filename);
+    const MappedFile &file = *mapping;
+    if (file.size() < sizeof(BinaryPlanHeader)) {
+        throw ContactPlanError("Not a binary contact plan: " + binary_filename);
+    }
+    const BinaryPlanHeader &header = *reinterpret_cast<const BinaryPlanHeader*>(file.data());
+    if (!std::equal(header.magic, header.magic + 8, BINARY_PLAN_MAGIC)) {
+        throw ContactPlanError("Not a binary contact plan: " + binary_filename);
+    }
+    if (header.version != BINARY_PLAN_VERSION || header.byte_order != BINARY_PLAN_BYTE_ORDER) {
+        throw ContactPlanError("Unsupported binary contact plan version in " + binary_filename);
+    }
+    const uint64_t V = header.num_vertices, P = header.num_pairs, E = header.num_contacts;
+    map_section(node_ids, file, header, SECTION_NODE_IDS, V, binary_filename);
+    map_section(adj_offsets, file, header, SECTION_ADJ_OFFSETS, V + 1, binary_filename);
+    map_section(pair_frm, file, header, SECTION_PAIR_FRM, P, binary_filename);
+    map_section(pair_to, file, header, SECTION_PAIR_TO, P, binary_filename);
+    map_section(pair_offsets, file, header, SECTION_PAIR_OFFSETS, P + 1, binary_filename);
+    map_section(start, file, header, SECTION_START, E, binary_filename);
+    map_section(end, file, header, SECTION_END, E, binary_filename);
+    map_section(owlt, file, header, SECTION_OWLT, E, binary_filename);
+    map_section(rate, file, header, SECTION_RATE, E, binary_filename);
+    map_section(id, file, header, SECTION_ID, E, binary_filename);
+    map_section(confidence, file, header, SECTION_CONFIDENCE, E, binary_filename);
+    map_section(plan_index, file, header, SECTION_PLAN_INDEX, E, binary_filename);
+    const uint64_t S = header.num_segments;
+    map_section(envelope_offsets, file, header, SECTION_ENVELOPE_OFFSETS, P + 1, binary_filename);
+    map_section(envelope_bound, file, header, SECTION_ENVELOPE_BOUND, S, binary_filename);
+    map_section(envelope_contact, file, header, SECTION_ENVELOPE_CONTACT, S, binary_filename);
+    map_section(longest_contact, file, header, SECTION_LONGEST_CONTACT, P, binary_filename);
+    // the offsets and vertex indices are trusted by the router, so make sure they stay inside
+    // the arrays, that every pair lies in the range of the vertex it leaves and that every
+    // envelope segment is an increasing bound with a contact of its own pair
+    bool valid = adj_offsets[0] == 0 && adj_offsets[V] == P && pair_offsets[0] == 0 && pair_offsets[P] == E
+        && envelope_offsets[0] == 0 && envelope_offsets[P] == S;
+    for (uint64_t v = 0; valid && v < V; ++v) {
+        valid = adj_offsets[v] <= adj_offsets[v + 1];
+        for (uint64_t pair = adj_offsets[v]; valid && pair < adj_offsets[v + 1]; ++pair) {
+            valid = pair_frm[pair] == v && pair_to[pair] < V && pair_offsets[pair] <= pair_offsets[pair + 1]
+                && envelope_offsets[pair] <= envelope_offsets[pair + 1];
+            for (uint32_t i = envelope_offsets[pair]; valid && i < envelope_offsets[pair + 1]; ++i) {
+                valid = envelope_contact[i] >= pair_offsets[pair] && envelope_contact[i] < pair_offsets[pair + 1]
+                    && (i == envelope_offsets[pair] || envelope_bound[i - 1] < envelope_bound[i]);
+            }
+        }
+    }
+    if (!valid) {
+        throw ContactPlanError("Corrupt binary contact plan " + binary_filename);
+    }
+}
+
+template <typename T>
+static void write_section(std::ofstream &file, BinaryPlanHeader &header, BinaryPlanSection section,
+                          const ArrayView<T> &view) {
+    static const char zeros[8] = { 0 };
+    const uint64_t offset = file.tellp();
+    const uint64_t aligned = (offset + 7) / 8 * 8;
+    file.write(zeros, aligned - offset);
+    header.sections[section] = aligned;
+    file.write(reinterpret_cast<const char*>(view.begin()), sizeof(T) * view.size());
+}
+
+void cp_save_binary(const std::vector<Contact> &contact_plan, std::string filename) {
+    if (!host_is_little_endian()) {
+        throw ContactPlanError("Binary contact plans are only supported on little-endian hosts");
+    }
+    const ContactMultigraph CM(contact_plan);
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw ContactPlanError("Cannot create binary contact plan " + filename);
+    }
+    BinaryPlanHeader header = BinaryPlanHeader();
+    std::copy(BINARY_PLAN_MAGIC, BINARY_PLAN_MAGIC + 8, header.magic);
+    header.version = BINARY_PLAN_VERSION;
+    header.byte_order = BINARY_PLAN_BYTE_ORDER;
+    header.num_vertices = CM.num_vertices();
+    header.num_pairs = CM.pair_to.size();
+    header.num_contacts = CM.num_contacts();
+    header.num_segments = CM.envelope_bound.size();
+    // header is written twice: first as a placeholder, then with the section offsets
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(file, header, SECTION_NODE_IDS, CM.node_ids);
+    write_section(file, header, SECTION_ADJ_OFFSETS, CM.adj_offsets);
+    write_section(file, header, SECTION_PAIR_FRM, CM.pair_frm);
+    write_section(file, header, SECTION_PAIR_TO, CM.pair_to);
+    write_section(file, header, SECTION_PAIR_OFFSETS, CM.pair_offsets);
+    write_section(file, header, SECTION_START, CM.start);
+    write_section(file, header, SECTION_END, CM.end);
+    write_section(file, header, SECTION_OWLT, CM.owlt);
+    write_section(file, header, SECTION_RATE, CM.rate);
+    write_section(file, header, SECTION_ID, CM.id);
+    write_section(file, header, SECTION_CONFIDENCE, CM.confidence);
+    write_section(file, header, SECTION_PLAN_INDEX, CM.plan_index);
+    write_section(file, header, SECTION_ENVELOPE_OFFSETS, CM.envelope_offsets);
+    write_section(file, header, SECTION_ENVELOPE_BOUND, CM.envelope_bound);
+    write_section(file, header, SECTION_ENVELOPE_CONTACT, CM.envelope_contact);
+    write_section(file, header, SECTION_LONGEST_CONTACT, CM.longest_contact);
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!file) {
+        throw ContactPlanError("Cannot write binary contact plan " + filename);
+    }
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &filename)
+    : addr(NULL), length(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(NULL)
+{
+    file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size;
+    if (file_handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_handle, &file_size) || 0 == file_size.QuadPart) {
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+        throw ContactPlanError("Cannot map contact plan " + filename);
+    }
+    length = static_cast<std::size_t>(file_size.QuadPart);
+    mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL != mapping_handle) {
+        addr = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (NULL == addr) {
+        if (NULL != mapping_handle) CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw ContactPlanError("Cannot map contact plan " + filename);
+    }
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(addr);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+}
+#else
+MappedFile::MappedFile(const std::string &filename)
+    : addr(NULL), length(0)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || 0 == st.st_size) {
+        if (fd >= 0) close(fd);
+        throw ContactPlanError("Cannot map contact plan " + filename);
+    }
+    length = st.st_size;
+    void *p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file referenced, the descriptor is no longer needed
+    close(fd);
+    if (MAP_FAILED == p) {
+        throw ContactPlanError("Cannot map contact plan " + filename);
+    }
+    addr = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(addr), length);
+}
+#endif
+
+const char* MappedFile::data() const {
+    return addr;
+}
+
+std::size_t MappedFile::size() const {
+    return length;
+}
+
+Arena::Arena(std::size_t initial_size)
+    : initial_size(initial_size), used(0)
+{
+}
+
+Arena::Arena(const Arena &other)
+    : initial_size(other.initial_size), used(0)
+{
+}
+
+Arena& Arena::operator=(const Arena &other) {
+    blocks.clear();
+    initial_size = other.initial_size;
+    used = 0;
+    return *this;
+}
+
+void* Arena::allocate(std::size_t bytes, std::size_t alignment) {
+    if (!blocks.empty()) {
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks.back().data.get());
+        const std::size_t offset = ((base + used + alignment - 1) & ~(alignment - 1)) - base;
+        if (offset + bytes <= blocks.back().size) {
+            used = offset + bytes;
+            return blocks.back().data.get() + offset;
+        }
+    }
+    // the blocks grow geometrically, so a search needs few of them however much it uses
+    Block block;
+    block.size = std::max(blocks.empty() ? initial_size : 2 * blocks.back().size, bytes + alignment);
+    block.data.reset(new char[block.size]);
+    blocks.push_back(std::move(block));
+    used = 0;
+    return allocate(bytes, alignment);
+}
+
+void Arena::reset() {
+    if (blocks.size() > 1) {
+        const std::size_t size = capacity();
+        blocks.clear();
+        Block block;
+        block.size = size;
+        block.data.reset(new char[size]);
+        blocks.push_back(std::move(block));
+    }
+    used = 0;
+}
+
+std::size_t Arena::capacity() const {
+    std::size_t size = 0;
+    for (const Block &block : blocks) {
+        size += block.size;
+    }
+    return size;
+}
+
+void QueryWorkspace::prepare(const ContactMultigraph &CM) {
+    arena.reset();
+    if (vertices.size() != CM.num_vertices()) {
+        vertices.clear();
+        vertices.reserve(CM.num_vertices());
+        for (nodeId_t id : CM.node_ids) {
+            vertices.push_back(Vertex(id));
+        }
+        touched.clear();
+        return;
+    }
+    for (uint32_t v : touched) {
+        vertices[v].arrival_time = MAX_SIZE;
+        vertices[v].visited = false;
+        vertices[v].predecessor = NO_INDEX;
+    }
+    touched.clear();
+}
+
+void QueryWorkspace::block(uint32_t v) {
+    if (!vertices[v].visited) {
+        vertices[v].visited = true;
+        touched.push_back(v);
+    }
+}
+
+ThreadPool::ThreadPool(unsigned num_workers)
+    : job(NULL), generation(0), ranges(new WorkRange[std::max(num_workers, 1u)]), busy_workers(0), stopping(false)
+{
+    // worker 0 is the thread that calls parallel_for()
+    for (unsigned worker = 1; worker < num_workers; ++worker) {
+        threads.push_back(std::thread(&ThreadPool::worker_loop, this, worker));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return threads.size() + 1;
+}
+
+bool ThreadPool::take(unsigned worker, uint32_t &index) {
+    {
+        WorkRange &own = ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            index = own.begin++;
+            return true;
+        }
+    }
+    // Steal the back half of the first worker found with indices left. Only one range is
+    // locked at a time; the stolen indices are not in any range until published below, but
+    // this worker runs them, so a worker that finds every range empty may stop.
+    const unsigned num_workers = size();
+    for (unsigned i = 1; i < num_workers; ++i) {
+        WorkRange &victim = ranges[(worker + i) % num_workers];
+        uint32_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end) {
+                continue;
+            }
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        WorkRange &own = ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        index = begin;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run_job(unsigned worker) {
+    uint32_t i;
+    while (take(worker, i)) {
+        try {
+            (*job)(i, worker);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+
+void ThreadPool::worker_loop(unsigned worker) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        run_job(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy_workers;
+        }
+        work_done.notify_one();
+    }
+}
+
+void ThreadPool::parallel_for(uint32_t n, const std::function<void(uint32_t, unsigned)> &task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        const unsigned num_workers = size();
+        for (unsigned worker = 0; worker < num_workers; ++worker) {
+            ranges[worker].begin = static_cast<uint64_t>(n) * worker / num_workers;
+            ranges[worker].end = static_cast<uint64_t>(n) * (worker + 1) / num_workers;
+        }
+        error = std::exception_ptr();
+        busy_workers = threads.size();
+        ++generation;
+    }
+    work_ready.notify_all();
+    run_job(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [&] { return 0 == busy_workers; });
+    job = NULL;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+MultigraphRouter::MultigraphRouter(const std::vector<Contact> &contact_plan)
+    : CM(contact_plan), policy(BINARY_HEAP), in_rebuilds(0)
+{
+    workspace.prepare(CM);
+}
+
+MultigraphRouter::MultigraphRouter(const std::vector<Contact> &contact_plan,
+                                   const std::vector<PeriodicContact> &periodic_contacts)
+    : CM(contact_plan, periodic_contacts), policy(BINARY_HEAP), in_rebuilds(0)
+{
+    workspace.prepare(CM);
+}
+
+MultigraphRouter::MultigraphRouter(const std::string &binary_filename)
+    : CM(binary_filename), policy(BINARY_HEAP), in_rebuilds(0)
+{
+    workspace.prepare(CM);
+}
+
+const ContactMultigraph& MultigraphRouter::graph() const {
+    return CM;
+}
+
+ContactMultigraph& MultigraphRouter::graph() {
+    return CM;
+}
+
+QueuePolicy MultigraphRouter::queue_policy() const {
+    return policy;
+}
+
+void MultigraphRouter::set_queue_policy(QueuePolicy queue_policy) {
+    policy = queue_policy;
+}
+
+bool MultigraphRouter::search(QueryWorkspace &ws, uint32_t src, uint32_t dst, int start_time,
+                              const std::vector<uint32_t> &excluded_contacts) const {
+    if (RADIX_HEAP == policy) {
+        ws.radix_queue.clear();
+        return search_with(ws.radix_queue, ws, src, dst, start_time, excluded_contacts);
+    }
+    ws.binary_queue.clear();
+    return search_with(ws.binary_queue, ws, src, dst, start_time, excluded_contacts);
+}
+
+/*
+ * Multigraph routing route-finding algorithm. Finds the shortest (least amount of time) path
+ * to transfer data throughout a network of nodes connected by temporary contacts.
+ */
+template <typename Queue>
+bool MultigraphRouter::search_with(Queue &PQ, QueryWorkspace &ws, uint32_t src, uint32_t dst, int start_time,
+                                   const std::vector<uint32_t> &excluded_contacts) const {
+    std::vector<Vertex> &vertices = ws.vertices;
+    // The source vertex's arrival time is the time data first arrives at the source node
+    vertices[src].arrival_time = start_time;
+    ws.touched.push_back(src);
+
+    // Min PQ of reached vertices ordered by arrival time. Only vertices that have been
+    // reached are pushed, and stale entries are skipped when popped ("lazy deletion").
+    // Source: https://stackoverflow.com/questions/9209323/easiest-way-of-using-min-priority-queue-with-key-update-in-c
+    PQ.push({ start_time, src });
+    while (!PQ.empty()) {
+        const uint32_t v_curr = PQ.top().vertex;
+        PQ.pop();
+        if (vertices[v_curr].visited) {
+            continue;
+        }
+        if (v_curr == dst) {
+            return true;
+        }
+        const int v_curr_arrival = vertices[v_curr].arrival_time;
+        // ------------- Multigraph Review Procedure start -------------
+        for (uint32_t pair = CM.adj_offsets[v_curr]; pair < CM.adj_offsets[v_curr + 1]; ++pair) {
+            const uint32_t u = CM.pair_to[pair];
+            if (vertices[u].visited) {
+                continue;
+            }
+            // find earliest usable contact from v_curr to u. If the latest contact leaving v_curr
+            // is closed by the time data gets to v_curr, there are no valid contacts.
+            const uint32_t best_contact = excluded_contacts.empty()
+                ? CM.contact_search(pair, v_curr_arrival)
+                : CM.contact_search(pair, v_curr_arrival, excluded_contacts);
+            if (NO_INDEX == best_contact) {
+                continue;
+            }
+            // owlt_mgn is used in the CMR algorithm, but is not part of this implementation because it was not used in CGR
+            // best_arr_time is the best time u can be reached by taking a contact from v_curr. if this is the fastest known route
+            // then update u's arrival time and predecessor
+            int best_arr_time = std::max(CM.contact_start(best_contact), v_curr_arrival) + CM.contact_owlt(best_contact);
+            if (best_arr_time < vertices[u].arrival_time) {
+                if (MAX_SIZE == vertices[u].arrival_time) {
+                    ws.touched.push_back(u);
+                }
+                vertices[u].arrival_time = best_arr_time;
+                vertices[u].predecessor = best_contact;
+                PQ.push({ best_arr_time, u });
+            }
+        }
+        vertices[v_curr].visited = true;
+        // ------------- Multigraph Review Procedure end -------------
+    }
+    return false;
+}
+
+template <typename Allocator>
+void MultigraphRouter::path_contacts(const QueryWorkspace &ws, uint32_t src, uint32_t dst,
+                                     std::vector<uint32_t, Allocator> &contacts) const {
+    const std::size_t first = contacts.size();
+    for (uint32_t v = dst; v != src; v = CM.pair_frm[CM.contact_pair(ws.vertices[v].predecessor)]) {
+        contacts.push_back(ws.vertices[v].predecessor);
+    }
+    std::reverse(contacts.begin() + first, contacts.end());
+}
+
+Route MultigraphRouter::route(QueryWorkspace &ws, nodeId_t source, nodeId_t destination, int start_time) const {
+    const uint32_t src = CM.vertex_index(source);
+    const uint32_t dst = CM.vertex_index(destination);
+    if (NO_INDEX == src || NO_INDEX == dst || src == dst) {
+        return Route();
+    }
+    ws.prepare(CM);
+    if (!search(ws, src, dst, start_time, std::vector<uint32_t>())) {
+        return Route();
+    }
+    // construct route from predecessors
+    ArenaVector<uint32_t> contacts(ws.arena);
+    path_contacts(ws, src, dst, contacts);
+    return CM.make_route(ArrayView<uint32_t>(contacts.data(), contacts.size()));
+}
+
+Route MultigraphRouter::route(nodeId_t source, nodeId_t destination, int start_time) {
+    return route(workspace, source, destination, start_time);
+}
+
+std::vector<Route> MultigraphRouter::route_batch(ArrayView<RouteQuery> queries, ThreadPool *pool) {
+    std::vector<Route> routes(queries.size());
+    if (NULL == pool) {
+        for (uint32_t i = 0; i < queries.size(); ++i) {
+            routes[i] = route(workspace, queries[i].source, queries[i].destination, queries[i].start_time);
+        }
+        return routes;
+    }
+    if (worker_workspaces.size() < pool->size()) {
+        worker_workspaces.resize(pool->size());
+    }
+    pool->parallel_for(queries.size(), [&](uint32_t i, unsigned worker) {
+        routes[i] = route(worker_workspaces[worker], queries[i].source, queries[i].destination, queries[i].start_time);
+    });
+    return routes;
+}
+
+RouteTree MultigraphRouter::route_tree(nodeId_t source, int start_time) {
+    return route_tree(workspace, source, start_time);
+}
+
+RouteTree MultigraphRouter::route_tree(QueryWorkspace &ws, nodeId_t source, int start_time) const {
+    RouteTree tree;
+    tree.CM = &CM;
+    tree.source_node = source;
+    tree.src = CM.vertex_index(source);
+    tree.start = start_time;
+    tree.version = CM.version();
+    tree.arrival = std::vector<int>(CM.num_vertices(), MAX_SIZE);
+    tree.predecessor = std::vector<uint32_t>(CM.num_vertices(), NO_INDEX);
+    if (NO_INDEX == tree.src) {
+        return tree;
+    }
+    ws.prepare(CM);
+    search(ws, tree.src, NO_INDEX, start_time, std::vector<uint32_t>());
+    for (uint32_t v : ws.touched) {
+        tree.arrival[v] = ws.vertices[v].arrival_time;
+        tree.predecessor[v] = ws.vertices[v].predecessor;
+    }
+    return tree;
+}
+
+void MultigraphRouter::index_incoming_pairs() {
+    const uint32_t num_pairs = CM.pair_frm.size();
+    if (!in_offsets.empty() && in_rebuilds == CM.rebuilds()) {
+        return;
+    }
+    in_rebuilds = CM.rebuilds();
+    in_offsets.assign(CM.num_vertices() + 1, 0);
+    for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+        ++in_offsets[CM.pair_to[pair] + 1];
+    }
+    for (uint32_t v = 0; v < CM.num_vertices(); ++v) {
+        in_offsets[v + 1] += in_offsets[v];
+    }
+    in_pairs.resize(num_pairs);
+    std::vector<uint32_t> fill(in_offsets.begin(), in_offsets.end() - 1);
+    for (uint32_t pair = 0; pair < num_pairs; ++pair) {
+        in_pairs[fill[CM.pair_to[pair]]++] = pair;
+    }
+}
+
+void MultigraphRouter::propagate(RouteTree &tree, bool subtree) {
+    BinaryQueue &PQ = workspace.binary_queue;
+    while (!PQ.empty()) {
+        const QueueEntry entry = PQ.top();
         PQ.pop();
-        if (v_next->id == destination) {
+        const uint32_t v = entry.vertex;
+        // stale entry: the vertex has been improved since
+        if (entry.arrival_time != tree.arrival[v]) {
+            continue;
+        }
+        for (uint32_t pair = CM.adj_offsets[v]; pair < CM.adj_offsets[v + 1]; ++pair) {
+            const uint32_t u = CM.pair_to[pair];
+            if (subtree && !in_subtree[u]) {
+                continue;
+            }
+            const uint32_t contact = CM.contact_search(pair, entry.arrival_time);
+            if (NO_INDEX == contact) {
+                continue;
+            }
+            const int arrival_time = std::max(CM.contact_start(contact), entry.arrival_time) + CM.contact_owlt(contact);
+            if (arrival_time < tree.arrival[u]) {
+                tree.arrival[u] = arrival_time;
+                tree.predecessor[u] = contact;
+                PQ.push({ arrival_time, u });
+            }
+        }
+    }
+}
+
+bool MultigraphRouter::remove_contact(RouteTree &tree, const Contact &contact) {
+    const bool current = tree.CM == &CM && tree.version == CM.version();
+    const uint32_t removed = CM.find_contact(contact);
+    if (!CM.remove_contact(contact)) {
+        return false;
+    }
+    if (!current) {
+        tree = route_tree(tree.source(), tree.start);
+        return true;
+    }
+    tree.version = CM.version();
+    const uint32_t u = CM.pair_to[CM.contact_pair(removed)];
+    if (tree.predecessor[u] != removed) {
+        // no route in the tree used the contact, and losing it cannot make any route faster
+        return true;
+    }
+
+    // The subtree below u lost its routes; everything else keeps its arrival time.
+    // A vertex x is a child of w if x's predecessor contact belongs to one of w's pairs.
+    if (in_subtree.size() != CM.num_vertices()) {
+        in_subtree.assign(CM.num_vertices(), false);
+    }
+    std::vector<uint32_t> subtree(1, u);
+    in_subtree[u] = true;
+    for (std::size_t i = 0; i < subtree.size(); ++i) {
+        const uint32_t w = subtree[i];
+        for (uint32_t pair = CM.adj_offsets[w]; pair < CM.adj_offsets[w + 1]; ++pair) {
+            const uint32_t x = CM.pair_to[pair];
+            if (!in_subtree[x] && NO_INDEX != tree.predecessor[x] && CM.contact_pair(tree.predecessor[x]) == pair) {
+                in_subtree[x] = true;
+                subtree.push_back(x);
+            }
+        }
+    }
+
+    // Start every subtree vertex from its best arrival over a pair from outside the subtree,
+    // then settle the subtree from those
+    index_incoming_pairs();
+    workspace.binary_queue.clear();
+    for (uint32_t x : subtree) {
+        tree.arrival[x] = MAX_SIZE;
+        tree.predecessor[x] = NO_INDEX;
+    }
+    for (uint32_t x : subtree) {
+        for (uint32_t i = in_offsets[x]; i < in_offsets[x + 1]; ++i) {
+            const uint32_t pair = in_pairs[i];
+            const uint32_t w = CM.pair_frm[pair];
+            if (in_subtree[w] || MAX_SIZE == tree.arrival[w]) {
+                continue;
+            }
+            const uint32_t c = CM.contact_search(pair, tree.arrival[w]);
+            if (NO_INDEX == c) {
+                continue;
+            }
+            const int arrival_time = std::max(CM.contact_start(c), tree.arrival[w]) + CM.contact_owlt(c);
+            if (arrival_time < tree.arrival[x]) {
+                tree.arrival[x] = arrival_time;
+                tree.predecessor[x] = c;
+            }
+        }
+        if (MAX_SIZE != tree.arrival[x]) {
+            workspace.binary_queue.push({ tree.arrival[x], x });
+        }
+    }
+    propagate(tree, true);
+    for (uint32_t x : subtree) {
+        in_subtree[x] = false;
+    }
+    return true;
+}
+
+void MultigraphRouter::add_contact(RouteTree &tree, const Contact &contact) {
+    const bool current = tree.CM == &CM && tree.version == CM.version();
+    const uint64_t rebuilds = CM.rebuilds();
+    CM.add_contact(contact);
+    if (!current || CM.rebuilds() != rebuilds) {
+        // the multigraph was rebuilt, so the tree's vertex and contact indices are stale
+        tree = route_tree(tree.source(), tree.start);
+        return;
+    }
+    tree.version = CM.version();
+    const uint32_t added = CM.find_contact(contact);
+    const uint32_t pair = CM.contact_pair(added);
+    const uint32_t w = CM.pair_frm[pair];
+    const uint32_t x = CM.pair_to[pair];
+    if (MAX_SIZE == tree.arrival[w] || CM.contact_end(added) <= tree.arrival[w]) {
+        return;
+    }
+    const int arrival_time = std::max(CM.contact_start(added), tree.arrival[w]) + CM.contact_owlt(added);
+    if (arrival_time >= tree.arrival[x]) {
+        return;
+    }
+    // only vertices the new contact gets data to earlier can change
+    tree.arrival[x] = arrival_time;
+    tree.predecessor[x] = added;
+    workspace.binary_queue.clear();
+    workspace.binary_queue.push({ arrival_time, x });
+    propagate(tree, false);
+}
+
+RouteTree::RouteTree()
+    : CM(NULL), source_node(0), src(NO_INDEX), start(0), version(0)
+{
+}
+
+nodeId_t RouteTree::source() const {
+    return source_node;
+}
+
+int RouteTree::start_time() const {
+    return start;
+}
+
+bool RouteTree::reachable(nodeId_t node) const {
+    return MAX_SIZE != arrival_time(node);
+}
+
+int RouteTree::arrival_time(nodeId_t node) const {
+    const uint32_t v = NULL == CM ? NO_INDEX : CM->vertex_index(node);
+    return NO_INDEX == v ? MAX_SIZE : arrival[v];
+}
+
+Route RouteTree::route(nodeId_t destination) const {
+    const uint32_t dst = NULL == CM ? NO_INDEX : CM->vertex_index(destination);
+    if (NO_INDEX == dst || NO_INDEX == src || dst == src || MAX_SIZE == arrival[dst]) {
+        return Route();
+    }
+    std::vector<uint32_t> contacts;
+    for (uint32_t v = dst; v != src; v = CM->pair_frm[CM->contact_pair(predecessor[v])]) {
+        contacts.push_back(predecessor[v]);
+    }
+    std::reverse(contacts.begin(), contacts.end());
+    return CM->make_route(contacts);
+}
+
+/*
+ * A hop of a route found by yen(). Hops form parent-linked lists, so all routes that share a
+ * root path point to the same hops for it instead of holding copies.
+ */
+struct YenHop {
+    uint32_t contact;
+    // vertex the hop arrives at and when
+    uint32_t vertex;
+    int arrival_time;
+    std::shared_ptr<const YenHop> parent;
+};
+
+struct YenPath {
+    std::shared_ptr<const YenHop> last;
+    uint32_t num_hops;
+    int arrival_time;
+};
+
+// Contacts of a path, from the source on
+static void yen_contacts(const YenPath &path, std::vector<uint32_t> &contacts) {
+    contacts.resize(path.num_hops);
+    uint32_t i = path.num_hops;
+    for (const YenHop *hop = path.last.get(); NULL != hop; hop = hop->parent.get()) {
+        contacts[--i] = hop->contact;
+    }
+}
+
+// Paths take the same contacts; the walk stops where they start sharing hops
+static bool yen_same_path(const YenPath &a, const YenPath &b) {
+    if (a.num_hops != b.num_hops) {
+        return false;
+    }
+    for (const YenHop *x = a.last.get(), *y = b.last.get(); x != y; x = x->parent.get(), y = y->parent.get()) {
+        if (x->contact != y->contact) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Candidate order: earliest arrival first, then fewest hops, then contact indices
+static bool yen_path_less(const YenPath &a, const YenPath &b) {
+    if (a.arrival_time != b.arrival_time) return a.arrival_time < b.arrival_time;
+    if (a.num_hops != b.num_hops) return a.num_hops < b.num_hops;
+    std::vector<uint32_t> a_contacts, b_contacts;
+    yen_contacts(a, a_contacts);
+    yen_contacts(b, b_contacts);
+    return a_contacts < b_contacts;
+}
+
+std::vector<Route> MultigraphRouter::yen(nodeId_t source, nodeId_t destination, int start_time, int num_routes,
+                                         ThreadPool *pool) {
+    std::vector<Route> routes;
+    const uint32_t src = CM.vertex_index(source);
+    const uint32_t dst = CM.vertex_index(destination);
+    if (NO_INDEX == src || NO_INDEX == dst || src == dst || num_routes <= 0) {
+        return routes;
+    }
+
+    // A: accepted routes, B: candidate routes. Candidates are only hop lists; the contacts of
+    // a route are listed once it is accepted, in A_contacts.
+    std::vector<YenPath> A, B;
+    std::vector<std::vector<uint32_t>> A_contacts;
+    workspace.prepare(CM);
+    if (!search(workspace, src, dst, start_time, std::vector<uint32_t>())) {
+        return routes;
+    }
+    std::vector<uint32_t> first_contacts;
+    path_contacts(workspace, src, dst, first_contacts);
+    YenPath first;
+    first.num_hops = first_contacts.size();
+    for (uint32_t contact : first_contacts) {
+        const uint32_t to = CM.pair_to[CM.contact_pair(contact)];
+        std::shared_ptr<YenHop> hop = std::make_shared<YenHop>();
+        hop->contact = contact;
+        hop->vertex = to;
+        hop->arrival_time = workspace.vertices[to].arrival_time;
+        hop->parent = first.last;
+        first.last = hop;
+    }
+    first.arrival_time = first.last->arrival_time;
+    A.push_back(first);
+    A_contacts.push_back(first_contacts);
+
+    const unsigned num_workers = NULL == pool ? 1 : pool->size();
+    if (worker_workspaces.size() < num_workers) {
+        worker_workspaces.resize(num_workers);
+    }
+
+    while (A.size() < static_cast<std::size_t>(num_routes)) {
+        const YenPath &previous = A.back();
+        const std::vector<uint32_t> &previous_contacts = A_contacts.back();
+        const uint32_t num_spurs = previous.num_hops;
+
+        // root path hops of previous route, root[i] is the last hop of the root ending at spur i
+        std::vector<std::shared_ptr<const YenHop>> root(num_spurs);
+        std::shared_ptr<const YenHop> hop = previous.last;
+        for (uint32_t i = num_spurs; i-- > 0; hop = hop->parent) {
+            root[i] = hop->parent;
+        }
+
+        std::vector<YenPath> spur_paths(num_spurs);
+        std::vector<char> found(num_spurs, false);
+        std::function<void(uint32_t, unsigned)> spur_search = [&](uint32_t i, unsigned worker) {
+            QueryWorkspace &ws = worker_workspaces[worker];
+            ws.prepare(CM);
+            const uint32_t spur_vertex = NULL == root[i] ? src : root[i]->vertex;
+            const int spur_time = NULL == root[i] ? start_time : root[i]->arrival_time;
+
+            // the next contact of every accepted route sharing this root path is excluded
+            std::vector<uint32_t> excluded;
+            for (const std::vector<uint32_t> &contacts : A_contacts) {
+                if (contacts.size() > i && std::equal(previous_contacts.begin(), previous_contacts.begin() + i,
+                                                      contacts.begin())) {
+                    excluded.push_back(contacts[i]);
+                }
+            }
+            std::sort(excluded.begin(), excluded.end());
+            // the root path's vertices are excluded so that routes stay loopless
+            for (std::shared_ptr<const YenHop> h = root[i]; NULL != h; h = h->parent) {
+                ws.block(CM.pair_frm[CM.contact_pair(h->contact)]);
+            }
+
+            if (!search(ws, spur_vertex, dst, spur_time, excluded)) {
+                return;
+            }
+            // the spur path's hops extend the root path's shared ones
+            ArenaVector<uint32_t> spur_contacts(ws.arena);
+            path_contacts(ws, spur_vertex, dst, spur_contacts);
+            YenPath &path = spur_paths[i];
+            path.num_hops = i + spur_contacts.size();
+            path.last = root[i];
+            for (uint32_t contact : spur_contacts) {
+                const uint32_t to = CM.pair_to[CM.contact_pair(contact)];
+                std::shared_ptr<YenHop> spur_hop = std::make_shared<YenHop>();
+                spur_hop->contact = contact;
+                spur_hop->vertex = to;
+                spur_hop->arrival_time = ws.vertices[to].arrival_time;
+                spur_hop->parent = path.last;
+                path.last = spur_hop;
+            }
+            path.arrival_time = path.last->arrival_time;
+            found[i] = true;
+        };
+        if (NULL == pool) {
+            for (uint32_t i = 0; i < num_spurs; ++i) {
+                spur_search(i, 0);
+            }
+        } else {
+            pool->parallel_for(num_spurs, spur_search);
+        }
+
+        // merge the new candidates in spur order, so the result does not depend on scheduling
+        for (uint32_t i = 0; i < num_spurs; ++i) {
+            if (!found[i]) {
+                continue;
+            }
+            bool duplicate = false;
+            for (const YenPath &path : B) {
+                duplicate = duplicate || yen_same_path(path, spur_paths[i]);
+            }
+            for (const YenPath &path : A) {
+                duplicate = duplicate || yen_same_path(path, spur_paths[i]);
+            }
+            if (!duplicate) {
+                B.push_back(spur_paths[i]);
+            }
+        }
+        if (B.empty()) {
             break;
         }
+        std::vector<YenPath>::iterator best = std::min_element(B.begin(), B.end(), yen_path_less);
+        A.push_back(*best);
+        A_contacts.emplace_back();
+        yen_contacts(*best, A_contacts.back());
+        B.erase(best);
+    }
+
+    for (const std::vector<uint32_t> &contacts : A_contacts) {
+        routes.push_back(CM.make_route(contacts));
+    }
+    return routes;
+}
+
+/*
+ * k shortest routes from source to destination for data ready at source at currTime.
+ * Builds a MultigraphRouter for a single query and runs the spur searches on the caller's
+ * pool, or serially without one, so a call does not start threads of its own.
+ */
+std::vector<Route> yen(nodeId_t source, nodeId_t destination, int currTime, const std::vector<Contact> &contactPlan, int numRoutes,
+                       ThreadPool *pool) {
+    MultigraphRouter router(contactPlan);
+    return router.yen(source, destination, currTime, numRoutes, pool);
+}
+
+RouteCache::RouteCache(const MultigraphRouter &router)
+    : router(&router), version(router.graph().version()), num_entries(0), num_hits(0), num_misses(0)
+{
+}
+
+Route RouteCache::route(nodeId_t source, nodeId_t destination, int start_time) {
+    if (router->graph().version() != version) {
+        clear();
+        version = router->graph().version();
+    }
+    Intervals &intervals = entries[std::make_pair(source, destination)];
+    // the cached route with the latest validity start at or before start_time
+    Intervals::iterator it = intervals.upper_bound(start_time);
+    if (it != intervals.begin()) {
+        --it;
+        if (start_time <= it->second.valid_until) {
+            ++num_hits;
+            return it->second.route;
+        }
+    }
+    ++num_misses;
+
+    Route route = router->route(workspace, source, destination, start_time);
+    Entry entry;
+    entry.route = route;
+    if (route.empty()) {
+        // nothing reachable departing at start_time is reachable departing later
+        entry.valid_until = MAX_SIZE;
+        insert(intervals, start_time, entry);
+        return route;
+    }
+    const ContactMultigraph &CM = router->graph();
+    std::vector<Contact> hops = route.get_hops();
+    // arrival time of data departing at start_time, then the latest departure that arrives
+    // no later: every hop must still be taken while its contact is open, and arrive in time
+    // for the next one
+    int arrival = start_time;
+    for (const Contact &hop : hops) {
+        arrival = std::max(arrival, hop.start) + hop.owlt;
+        entry.contacts.push_back(CM.find_contact(hop));
+    }
+    entry.valid_until = arrival;
+    for (std::vector<Contact>::reverse_iterator hop = hops.rbegin(); hop != hops.rend(); ++hop) {
+        entry.valid_until = std::min(entry.valid_until - hop->owlt, hop->end - 1);
+    }
+    std::sort(entry.contacts.begin(), entry.contacts.end());
+    insert(intervals, start_time, entry);
+    return route;
+}
+
+void RouteCache::insert(Intervals &intervals, int start_time, const Entry &entry) {
+    // Intervals starting later that end no later are covered. Those that end later stay: they
+    // are the ones to look up for departures from their start on.
+    Intervals::iterator it = intervals.lower_bound(start_time);
+    while (it != intervals.end() && it->second.valid_until <= entry.valid_until) {
+        it = intervals.erase(it);
+        --num_entries;
+    }
+    if (it == intervals.end() || it->first != start_time) {
+        intervals.emplace_hint(it, start_time, entry);
+        ++num_entries;
+    }
+}
+
+void RouteCache::invalidate(const Contact &contact) {
+    const uint32_t c = router->graph().find_contact(contact);
+    if (NO_INDEX == c || router->graph().version() != version) {
+        return;
+    }
+    for (std::map<std::pair<nodeId_t, nodeId_t>, Intervals>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        Intervals &intervals = it->second;
+        for (Intervals::iterator entry = intervals.begin(); entry != intervals.end(); ) {
+            const std::vector<uint32_t> &contacts = entry->second.contacts;
+            if (std::binary_search(contacts.begin(), contacts.end(), c)) {
+                entry = intervals.erase(entry);
+                --num_entries;
+            }
+            else {
+                ++entry;
+            }
+        }
+    }
+}
+
+void RouteCache::expire(int now) {
+    for (std::map<std::pair<nodeId_t, nodeId_t>, Intervals>::iterator it = entries.begin(); it != entries.end(); ) {
+        Intervals &intervals = it->second;
+        for (Intervals::iterator entry = intervals.begin(); entry != intervals.end(); ) {
+            if (entry->second.valid_until < now) {
+                entry = intervals.erase(entry);
+                --num_entries;
+            }
+            else {
+                ++entry;
+            }
+        }
+        if (intervals.empty()) {
+            it = entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void RouteCache::clear() {
+    entries.clear();
+    num_entries = 0;
+}
+
+std::size_t RouteCache::size() const {
+    return num_entries;
+}
+
+uint64_t RouteCache::hits() const {
+    return num_hits;
+}
+
+uint64_t RouteCache::misses() const {
+    return num_misses;
+}
+
+
+
+/*
+ * SAX handler for boost::json::basic_parser that builds contacts straight from the parse
+ * events of a contact plan file: {"contacts": [{"source": .., "dest": .., ...}, ...]}.
+ * Only the fields of the contact currently being parsed are held in memory.
+ */
+class ContactPlanHandler {
+public:
+    static constexpr std::size_t max_array_size = -1;
+    static constexpr std::size_t max_object_size = -1;
+    static constexpr std::size_t max_string_size = -1;
+    static constexpr std::size_t max_key_size = -1;
+
+    std::vector<Contact> &contacts;
+    // where periodic contacts go; if NULL they are expanded into contacts
+    std::vector<PeriodicContact> *periodic_contacts;
+    const int max_contacts;
+    // set once max_contacts entries have been read; the handler then stops the parser
+    bool full;
+
+    ContactPlanHandler(std::vector<Contact> &contacts, std::vector<PeriodicContact> *periodic_contacts, int max_contacts)
+        : contacts(contacts), periodic_contacts(periodic_contacts), max_contacts(max_contacts), full(false),
+          num_entries(0), depth(0), in_contacts(false), field(NONE)
+    {
+    }
+
+    bool on_document_begin(boost::json::error_code&) { return true; }
+    bool on_document_end(boost::json::error_code&) { return true; }
+
+    bool on_array_begin(boost::json::error_code&) {
+        ++depth;
+        // the contact list is the array under the top level "contacts" key
+        if (2 == depth && CONTACTS == field) {
+            in_contacts = true;
+        }
+        field = NONE;
+        return true;
+    }
+
+    bool on_array_end(std::size_t, boost::json::error_code&) {
+        if (2 == depth) {
+            in_contacts = false;
+        }
+        --depth;
+        return true;
+    }
+
+    bool on_object_begin(boost::json::error_code&) {
+        ++depth;
+        if (in_contacts && 3 == depth) {
+            // defaults match the Contact constructor and the old property_tree loader
+            frm = to = 0;
+            start = end = rate = 0;
+            owlt = 1;
+            id = -1;
+            confidence = 1;
+            period = repeat = 0;
+            until = MAX_SIZE;
+        }
+        field = NONE;
+        return true;
+    }
+
+    bool on_object_end(std::size_t, boost::json::error_code&) {
+        if (in_contacts && 3 == depth) {
+            Contact contact(frm, to, start, end, rate, confidence, owlt);
+            contact.id = id;
+            if (0 == period) {
+                contacts.push_back(contact);
+            }
+            else {
+                add_periodic(contact);
+            }
+            if (++num_entries == max_contacts) {
+                full = true;
+                return false;
+            }
+        }
+        --depth;
+        field = NONE;
+        return true;
+    }
+
+    bool on_key_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+        key.append(s.data(), s.size());
+        return true;
+    }
+
+    bool on_key(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+        key.append(s.data(), s.size());
+        field = NONE;
+        if (1 == depth && key == "contacts") {
+            field = CONTACTS;
+        } else if (in_contacts && 3 == depth) {
+            if (key == "source") field = SOURCE;
+            else if (key == "dest") field = DEST;
+            else if (key == "startTime") field = START;
+            else if (key == "endTime") field = END;
+            else if (key == "rate") field = RATE;
+            else if (key == "owlt") field = OWLT;
+            else if (key == "confidence") field = CONFIDENCE;
+            else if (key == "contact") field = ID;
+            else if (key == "period") field = PERIOD;
+            else if (key == "repeat") field = REPEAT;
+            else if (key == "until") field = UNTIL;
+        }
+        key.clear();
+        return true;
+    }
+
+    bool on_string_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+        if (NONE != field) {
+            value.append(s.data(), s.size());
+        }
+        return true;
+    }
+
+    bool on_string(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+        // property_tree stored every value as a string, so numbers in quotes were accepted
+        if (NONE != field) {
+            value.append(s.data(), s.size());
+            if (RATE == field || CONFIDENCE == field) {
+                set_field(std::strtod(value.c_str(), NULL));
+            }
+            else if (SOURCE == field || DEST == field) {
+                set_field(std::strtoull(value.c_str(), NULL, 10));
+            }
+            else {
+                set_field(std::strtoll(value.c_str(), NULL, 10));
+            }
+            value.clear();
+        }
+        return true;
+    }
+
+    bool on_number_part(boost::json::string_view, boost::json::error_code&) { return true; }
+
+    bool on_int64(int64_t i, boost::json::string_view, boost::json::error_code&) {
+        set_field(i);
+        return true;
+    }
+
+    bool on_uint64(uint64_t u, boost::json::string_view, boost::json::error_code&) {
+        set_field(u);
+        return true;
+    }
+
+    bool on_double(double d, boost::json::string_view, boost::json::error_code &ec) {
+        // a double holds integers exactly only up to 2^53, so node ids and times must be integers
+        if (NONE != field && RATE != field && CONFIDENCE != field) {
+            ec = boost::json::error::not_exact;
+            return false;
+        }
+        set_field(d);
+        return true;
+    }
+
+    bool on_bool(bool, boost::json::error_code&) { field = NONE; return true; }
+    bool on_null(boost::json::error_code&) { field = NONE; return true; }
+    bool on_comment_part(boost::json::string_view, boost::json::error_code&) { return true; }
+    bool on_comment(boost::json::string_view, boost::json::error_code&) { return true; }
+
+private:
+    enum Field { NONE, CONTACTS, SOURCE, DEST, START, END, RATE, OWLT, CONFIDENCE, ID, PERIOD, REPEAT, UNTIL };
+    int num_entries;
+    int depth;
+    bool in_contacts;
+    Field field;
+    std::string key, value;
+    // fields of the contact being parsed
+    nodeId_t frm, to;
+    int start, end, rate, owlt, id;
+    float confidence;
+    // periodic contacts: occurrences every `period`, `repeat` of them or those ending by `until`
+    int period, repeat, until;
+
+    void add_periodic(const Contact &contact) {
+        if (repeat <= 0 && MAX_SIZE == until) {
+            throw std::invalid_argument("a periodic contact needs a repeat count or an until time");
+        }
+        PeriodicContact periodic_contact = repeat > 0 ? PeriodicContact(contact, period, repeat)
+                                                      : PeriodicContact::until(contact, period, until);
+        if (NULL != periodic_contacts) {
+            periodic_contacts->push_back(periodic_contact);
+        }
         else {
-            v_curr = v_next;
+            const std::vector<Contact> occurrences = periodic_contact.occurrences();
+            contacts.insert(contacts.end(), occurrences.begin(), occurrences.end());
         }
     }
 
+    template <typename T>
+    void set_field(T v) {
+        switch (field) {
+        case SOURCE: frm = static_cast<nodeId_t>(v); break;
+        case DEST: to = static_cast<nodeId_t>(v); break;
+        case START: start = static_cast<int>(v); break;
+        case END: end = static_cast<int>(v); break;
+        case RATE: rate = static_cast<int>(v); break;
+        case OWLT: owlt = static_cast<int>(v); break;
+        case CONFIDENCE: confidence = static_cast<float>(v); break;
+        case ID: id = static_cast<int>(v); break;
+        case PERIOD: period = static_cast<int>(v); break;
+        case REPEAT: repeat = static_cast<int>(v); break;
+        case UNTIL: until = static_cast<int>(v); break;
+        default: break;
+        }
+        field = NONE;
+    }
+};
 
-    // test prints for the sake of debugging
+ContactPlanError::ContactPlanError(const std::string &message)
+    : std::runtime_error(message)
+{
+}
 
-  /*  std::cout << "--- Contact Plan ---" << std::endl;
-    for (Contact &c : contact_plan) {
-        std::cout << c << std::endl;
+/*
+ * Loads a JSON contact plan. The file is read in fixed size chunks and parsed in a
+ * single streaming pass, so apart from the returned contacts memory use is constant.
+ * Stops after max_contacts contacts. Periodic contacts are returned in periodic_contacts
+ * if it is given, and expanded into their occurrences otherwise.
+ */
+static std::vector<Contact> parse_contact_plan(const std::string &filename, std::vector<PeriodicContact> *periodic_contacts,
+                                               int max_contacts) {
+    std::vector<Contact> contactsVector;
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file) {
+        throw ContactPlanError("Cannot open contact plan " + filename);
     }
-    std::cout << "--- Predecessors ---" << std::endl;
-    for (auto pr : CM.predecessors) {
-        if (pr.first == 1) {
-            continue;
+
+    boost::json::basic_parser<ContactPlanHandler> parser(boost::json::parse_options(), contactsVector, periodic_contacts, max_contacts);
+    std::vector<char> buffer(1 << 16);
+    boost::json::error_code ec;
+    bool more = true;
+    while (more) {
+        file.read(buffer.data(), buffer.size());
+        const std::size_t n = file.gcount();
+        more = !file.eof() && !file.fail();
+        try {
+            parser.write_some(more, buffer.data(), n, ec);
+        }
+        catch (const std::invalid_argument &e) {
+            throw ContactPlanError("Invalid periodic contact in contact plan " + filename + ": " + e.what());
+        }
+        if (parser.handler().full) {
+            break;
+        }
+        if (ec) {
+            throw ContactPlanError("Cannot parse contact plan " + filename + ": " + ec.message());
         }
-        std::cout << "Vertex " << pr.first << ": ";
-        std::cout << contact_plan[pr.second] << std::endl;
-    }*/
+    }
+    return contactsVector;
+}
 
+std::vector<Contact> cp_load(std::string filename, int max_contacts) {
+    return parse_contact_plan(filename, NULL, max_contacts);
+}
 
-    // construct route from predecessors
-    std::vector<Contact> hops;
-    Contact* contact;
-    for (contact = v_next->predecessor; contact->frm != contact->to; contact = CM.vertices[contact->frm]->predecessor) {
-        hops.push_back(*contact);
-        if (contact->frm == root_contact->frm) { // meaning if we've just inserted our first contact
+std::vector<Contact> cp_load(std::string filename, std::vector<PeriodicContact> &periodic_contacts, int max_contacts) {
+    periodic_contacts.clear();
+    return parse_contact_plan(filename, &periodic_contacts, max_contacts);
+}
+
+ContactGraph::ContactGraph(const std::vector<Contact> &contact_plan)
+    : plan(&contact_plan) {
+    // Fixed parameters of the contact plan, packed into parallel arrays
+    contacts.reserve(contact_plan.size());
+    for (const Contact &contact : contact_plan) {
+        contacts.push_back(contact);
+    }
+    const uint32_t num_contacts = contacts.size();
+
+    // The neighbour index helps us find the contacts sent by a node. Counting sort by
+    // sending node keeps each node's contacts in contact plan order.
+    node_ids = contacts.frm;
+    node_ids.insert(node_ids.end(), contacts.to.begin(), contacts.to.end());
+    std::sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(std::unique(node_ids.begin(), node_ids.end()), node_ids.end());
+    std::vector<uint32_t> sender(num_contacts);
+    receiver.resize(num_contacts);
+    adj_offsets.assign(node_ids.size() + 1, 0);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        sender[i] = std::lower_bound(node_ids.begin(), node_ids.end(), contacts.frm[i]) - node_ids.begin();
+        receiver[i] = std::lower_bound(node_ids.begin(), node_ids.end(), contacts.to[i]) - node_ids.begin();
+        ++adj_offsets[sender[i] + 1];
+    }
+    for (uint32_t n = 0; n < node_ids.size(); ++n) {
+        adj_offsets[n + 1] += adj_offsets[n];
+    }
+    adjacency.resize(num_contacts);
+    std::vector<uint32_t> fill(adj_offsets.begin(), adj_offsets.end() - 1);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        adjacency[fill[sender[i]]++] = i;
+    }
+
+    // Each node's contacts by end time, so the ones still open at a time are a suffix of them
+    for (uint32_t n = 0; n < node_ids.size(); ++n) {
+        std::stable_sort(adjacency.begin() + adj_offsets[n], adjacency.begin() + adj_offsets[n + 1],
+            [this](uint32_t a, uint32_t b) { return contacts.end[a] < contacts.end[b]; });
+    }
+    adjacency_end.resize(num_contacts);
+    for (uint32_t a = 0; a < num_contacts; ++a) {
+        adjacency_end[a] = contacts.end[adjacency[a]];
+    }
+}
+
+ContactGraphWorkspace::ContactGraphWorkspace()
+    : epoch(0), node_epoch(0)
+{
+}
+
+void ContactGraphWorkspace::prepare(uint32_t num_contacts, uint32_t num_nodes) {
+    // The root contact is not part of the contact plan and takes the extra last entry
+    if (stamp.size() != num_contacts + 1) {
+        stamp.assign(num_contacts + 1, 0);
+        arrival_time.resize(num_contacts + 1);
+        visited.resize(num_contacts + 1);
+        predecessor.resize(num_contacts + 1);
+        frontier.resize(num_contacts);
+        epoch = 0;
+    }
+    if (node_mark.size() != num_nodes) {
+        node_mark.assign(num_nodes, 0);
+        node_epoch = 0;
+    }
+    if (0 == ++epoch) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        epoch = 1;
+    }
+    frontier.clear();
+    arena.reset();
+}
+
+void ContactGraphWorkspace::clear_nodes() {
+    if (0 == ++node_epoch) {
+        std::fill(node_mark.begin(), node_mark.end(), 0);
+        node_epoch = 1;
+    }
+}
+
+void ContactGraphWorkspace::touch(uint32_t i) {
+    if (stamp[i] != epoch) {
+        stamp[i] = epoch;
+        arrival_time[i] = MAX_SIZE;
+        visited[i] = false;
+        predecessor[i] = NO_INDEX;
+    }
+}
+
+Route ContactGraph::dijkstra(Contact *root_contact, nodeId_t destination) {
+    return dijkstra(workspace, root_contact, destination);
+}
+
+Route ContactGraph::dijkstra(ContactGraphWorkspace &ws, Contact *root_contact, nodeId_t destination) const {
+    const std::vector<Contact> &contact_plan = *plan;
+    const uint32_t root = contacts.size();
+    ws.prepare(contacts.size(), node_ids.size());
+    std::vector<int> &arrival_time = ws.arrival_time;
+    std::vector<char> &visited = ws.visited;
+    std::vector<uint32_t> &predecessor = ws.predecessor;
+    std::vector<uint32_t> &node_mark = ws.node_mark;
+    IndexedQueue &frontier = ws.frontier;
+
+    Route route;
+    uint32_t final_contact = NO_INDEX, final_predecessor = NO_INDEX;
+    int earliest_fin_arr_t = MAX_SIZE;
+    int arrvl_time;
+
+    if (!vector_contains(root_contact->visited_nodes, root_contact->to)) {
+        root_contact->visited_nodes.push_back(root_contact->to);
+    }
+    ws.touch(root);
+    arrival_time[root] = root_contact->arrival_time;
+
+    uint32_t current = root;
+    while (true) {
+        const nodeId_t current_frm = current == root ? root_contact->frm : contacts.frm[current];
+        const nodeId_t current_to = current == root ? root_contact->to : contacts.to[current];
+        const std::vector<Contact> &suppressed_next_hop = current == root
+            ? root_contact->suppressed_next_hop : contact_plan[current].suppressed_next_hop;
+
+        // Mark the nodes the route to the current contact visits: the receivers along its
+        // predecessor chain and the nodes the root contact had already visited. Nodes not in
+        // the contact plan receive no contact and need no mark.
+        ws.clear_nodes();
+        for (uint32_t c = current; c != root; c = predecessor[c]) {
+            node_mark[receiver[c]] = ws.node_epoch;
+        }
+        for (nodeId_t visited_node : root_contact->visited_nodes) {
+            std::vector<nodeId_t>::const_iterator n = std::lower_bound(node_ids.begin(), node_ids.end(), visited_node);
+            if (n != node_ids.end() && *n == visited_node) {
+                node_mark[n - node_ids.begin()] = ws.node_epoch;
+            }
+        }
+
+        // loop over the neighbors of the current contact's source node that are still open
+        // when data arrives over it
+        uint32_t n = NO_INDEX;
+        if (current != root) {
+            n = receiver[current];
+        } else {
+            std::vector<nodeId_t>::const_iterator node = std::lower_bound(node_ids.begin(), node_ids.end(), current_to);
+            if (node != node_ids.end() && *node == current_to) {
+                n = node - node_ids.begin();
+            }
+        }
+        if (NO_INDEX != n) {
+            const uint32_t first_open = std::upper_bound(adjacency_end.begin() + adj_offsets[n],
+                adjacency_end.begin() + adj_offsets[n + 1], arrival_time[current]) - adjacency_end.begin();
+            for (uint32_t a = first_open; a < adj_offsets[n + 1]; ++a) {
+                const uint32_t contact = adjacency[a];
+                const Contact &plan_contact = contact_plan[contact];
+                if (!suppressed_next_hop.empty() && vector_contains(suppressed_next_hop, plan_contact)) {
+                    continue;
+                }
+                if (plan_contact.suppressed) {
+                    continue;
+                }
+                ws.touch(contact);
+                if (visited[contact]) {
+                    continue;
+                }
+                if (node_mark[receiver[contact]] == ws.node_epoch) {
+                    continue;
+                }
+                if (*std::max_element(plan_contact.mav.begin(), plan_contact.mav.end()) <= 0) {
+                    continue;
+                }
+                if (current_frm == contacts.to[contact] && current_to == contacts.frm[contact]) {
+                    continue;
+                }
+
+                // Calculate arrival time (cost)
+                if (contacts.start[contact] < arrival_time[current]) {
+                    arrvl_time = arrival_time[current] + contacts.owlt[contact];
+                } else {
+                    arrvl_time = contacts.start[contact] + contacts.owlt[contact];
+                }
+
+                if (arrvl_time <= arrival_time[contact]) {
+                    const QueueEntry entry = { arrvl_time, contact };
+                    if (MAX_SIZE == arrival_time[contact]) {
+                        frontier.push(entry);
+                    } else if (arrvl_time < arrival_time[contact]) {
+                        frontier.decrease(entry);
+                    }
+                    arrival_time[contact] = arrvl_time;
+                    predecessor[contact] = current;
+
+                    // on a tie between neighbours, the one first in the contact plan
+                    if (contacts.to[contact] == destination && (arrival_time[contact] < earliest_fin_arr_t
+                            || (arrival_time[contact] == earliest_fin_arr_t && final_predecessor == current && contact < final_contact))) {
+                        earliest_fin_arr_t = arrival_time[contact];
+                        final_contact = contact;
+                        final_predecessor = current;
+                    }
+                }
+            }
+        }
+
+        visited[current] = true;
+
+        // determine next best contact: the earliest reached one, lowest index first on ties.
+        // Contacts arriving after the best arrival at the destination found so far cannot
+        // improve on it, so the search ends once the earliest one does.
+        if (frontier.empty() || frontier.top().arrival_time > earliest_fin_arr_t) {
             break;
         }
+
+        current = frontier.top().vertex;
+        frontier.pop();
     }
-    Route route;
-    route = Route(hops.back());
-    hops.pop_back();
-    while (!hops.empty()) {
-        route.append(hops.back());
+
+    if (final_contact != NO_INDEX) {
+        ArenaVector<uint32_t> hops(ws.arena);
+        for (uint32_t contact = final_contact; contact != root; contact = predecessor[contact]) {
+            hops.push_back(contact);
+        }
+
+        route = Route(contact_plan[hops.back()]);
         hops.pop_back();
+        while (!hops.empty()) {
+            route.append(contact_plan[hops.back()]);
+            hops.pop_back();
+        }
+    }
+
+    return route;
+}
+
+void ConnectionScanWorkspace::prepare(uint32_t num_vertices) {
+    arena.reset();
+    if (arrival_time.size() != num_vertices) {
+        arrival_time.assign(num_vertices, MAX_SIZE);
+        predecessor.assign(num_vertices, NO_INDEX);
+        touched.clear();
+        return;
+    }
+    for (uint32_t v : touched) {
+        arrival_time[v] = MAX_SIZE;
+        predecessor[v] = NO_INDEX;
+    }
+    touched.clear();
+}
+
+ConnectionScanRouter::ConnectionScanRouter(const std::vector<Contact> &contact_plan)
+    : max_duration(0) {
+    // Connections: the contacts in start time order
+    const uint32_t num_contacts = contact_plan.size();
+    std::vector<uint32_t> order(num_contacts);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return contact_plan[a].start < contact_plan[b].start;
+    });
+    contacts.reserve(num_contacts);
+    for (uint32_t i : order) {
+        contacts.push_back(contact_plan[i]);
+        max_duration = std::max(max_duration, contact_plan[i].end - contact_plan[i].start);
+    }
+
+    // Node dictionary and the contacts sent by each vertex, kept in start time order
+    node_ids = contacts.frm;
+    node_ids.insert(node_ids.end(), contacts.to.begin(), contacts.to.end());
+    std::sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(std::unique(node_ids.begin(), node_ids.end()), node_ids.end());
+    frm.resize(num_contacts);
+    to.resize(num_contacts);
+    out_offsets.assign(node_ids.size() + 1, 0);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        frm[i] = vertex_index(contacts.frm[i]);
+        to[i] = vertex_index(contacts.to[i]);
+        ++out_offsets[frm[i] + 1];
+    }
+    for (uint32_t v = 0; v < node_ids.size(); ++v) {
+        out_offsets[v + 1] += out_offsets[v];
+    }
+    out_contacts.resize(num_contacts);
+    std::vector<uint32_t> fill(out_offsets.begin(), out_offsets.end() - 1);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        out_contacts[fill[frm[i]]++] = i;
+    }
+
+    // The contacts received by each vertex, in start time order, for profile queries
+    in_offsets.assign(node_ids.size() + 1, 0);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        ++in_offsets[to[i] + 1];
+    }
+    for (uint32_t v = 0; v < node_ids.size(); ++v) {
+        in_offsets[v + 1] += in_offsets[v];
+    }
+    in_contacts.resize(num_contacts);
+    fill.assign(in_offsets.begin(), in_offsets.end() - 1);
+    for (uint32_t i = 0; i < num_contacts; ++i) {
+        in_contacts[fill[to[i]]++] = i;
+    }
+}
+
+uint32_t ConnectionScanRouter::vertex_index(nodeId_t id) const {
+    std::vector<nodeId_t>::const_iterator it = std::lower_bound(node_ids.begin(), node_ids.end(), id);
+    return (it == node_ids.end() || *it != id) ? NO_INDEX : it - node_ids.begin();
+}
+
+void ConnectionScanRouter::relax(ConnectionScanWorkspace &ws, uint32_t c, int arrival_time) const {
+    if (arrival_time >= contacts.end[c]) {
+        return;
+    }
+    const uint32_t v = to[c];
+    const int arrival = std::max(contacts.start[c], arrival_time) + contacts.owlt[c];
+    if (arrival < ws.arrival_time[v]) {
+        if (MAX_SIZE == ws.arrival_time[v]) {
+            ws.touched.push_back(v);
+        }
+        ws.arrival_time[v] = arrival;
+        ws.predecessor[v] = c;
+        ws.replay.push_back(v);
+    }
+}
+
+Route ConnectionScanRouter::route(ConnectionScanWorkspace &ws, nodeId_t source, nodeId_t destination, int start_time) const {
+    const uint32_t src = vertex_index(source);
+    const uint32_t dst = vertex_index(destination);
+    if (NO_INDEX == src || NO_INDEX == dst || src == dst) {
+        return Route();
+    }
+    scan(ws, src, dst, start_time, MAX_SIZE);
+    if (MAX_SIZE == ws.arrival_time[dst]) {
+        return Route();
+    }
+
+    // construct route from predecessors
+    ArenaVector<uint32_t> hops(ws.arena);
+    for (uint32_t v = dst; v != src; v = frm[ws.predecessor[v]]) {
+        hops.push_back(ws.predecessor[v]);
+    }
+    Route route(contacts.contact(hops.back()));
+    for (std::size_t i = hops.size() - 1; i-- > 0; ) {
+        route.append(contacts.contact(hops[i]));
     }
     return route;
 }
 
+void ConnectionScanRouter::scan(ConnectionScanWorkspace &ws, uint32_t src, uint32_t dst, int start_time, int last_start) const {
+    ws.prepare(node_ids.size());
+    ws.replay.clear();
+    ws.arrival_time[src] = start_time;
+    ws.touched.push_back(src);
+
+    // no contact that started before start_time - max_duration is still open at start_time
+    const int64_t first_start = static_cast<int64_t>(start_time) - max_duration;
+    const uint32_t first = std::lower_bound(contacts.start.begin(), contacts.start.end(), first_start,
+        [](int start, int64_t time) { return start < time; }) - contacts.start.begin();
+    for (uint32_t c = first; c < contacts.size() && contacts.start[c] <= last_start; ++c) {
+        // data cannot leave over this or any later contact before the destination is reached
+        if (NO_INDEX != dst && contacts.start[c] >= ws.arrival_time[dst]) {
+            break;
+        }
+        relax(ws, c, ws.arrival_time[frm[c]]);
+        // Vertices reached while scanning c can still use contacts scanned before it. All of
+        // them started by now, and they can only be open at the new arrival time if they
+        // started at most max_duration before it.
+        while (!ws.replay.empty()) {
+            const uint32_t u = ws.replay.back();
+            ws.replay.pop_back();
+            const int arrival_time = ws.arrival_time[u];
+            const uint32_t *first_out = out_contacts.data() + out_offsets[u];
+            const uint32_t *last_out = out_contacts.data() + out_offsets[u + 1];
+            // out contacts are in scan order, so the scanned ones are those up to c
+            last_out = std::upper_bound(first_out, last_out, c);
+            first_out = std::lower_bound(first_out, last_out, static_cast<int64_t>(arrival_time) - max_duration,
+                [this](uint32_t out, int64_t time) { return contacts.start[out] < time; });
+            for (const uint32_t *out = first_out; out != last_out; ++out) {
+                relax(ws, *out, arrival_time);
+            }
+        }
+    }
+}
+
+Route ConnectionScanRouter::route(nodeId_t source, nodeId_t destination, int start_time) {
+    return route(workspace, source, destination, start_time);
+}
+
+// A way on to the destination from a node in a profile connection scan: data that reaches the
+// node by latest_departure takes contact, then the way on labels[next] from the node it leads
+// to, and arrives at max(departure + duration, earliest_arrival). The destination has a single
+// label without a contact.
+struct ProfileLabel {
+    int latest_departure, duration, earliest_arrival;
+    uint32_t contact, next;
+};
+
+// A piece of a node's profile: labels[label] is the best way on for departures from first to
+// last. The label's duration and earliest arrival are kept with it for comparing.
+struct ProfilePiece {
+    uint32_t label;
+    int first, last;
+    int duration, earliest_arrival;
+};
+
+template <typename T>
+static int profile_arrival(const T &label, int departure) {
+    return std::max(departure + label.duration, label.earliest_arrival);
+}
+
+ArrivalProfile ConnectionScanRouter::profile(nodeId_t source, nodeId_t destination, int first_departure, int last_departure) {
+    return profile(workspace, source, destination, first_departure, last_departure);
+}
+
+ArrivalProfile ConnectionScanRouter::profile(ConnectionScanWorkspace &ws, nodeId_t source, nodeId_t destination,
+                                             int first_departure, int last_departure) const {
+    ArrivalProfile profile;
+    const uint32_t src = vertex_index(source);
+    const uint32_t dst = vertex_index(destination);
+    if (NO_INDEX == src || NO_INDEX == dst || src == dst || last_departure < first_departure) {
+        return profile;
+    }
+
+    // Arrival times do not decrease with the departure time, so a way on that cannot arrive by
+    // the earliest arrival of the last departure is never the best one. Data sent in the window
+    // cannot reach a vertex before it does when sent at first_departure, so the profile of a
+    // vertex starts at that time.
+    scan(ws, src, dst, last_departure, MAX_SIZE);
+    const int latest_arrival = ws.arrival_time[dst];
+    scan(ws, src, NO_INDEX, first_departure, latest_arrival);
+    const std::vector<int> &reached = ws.arrival_time;
+
+    // Per vertex, its profile so far: the pieces in departure order, with gaps where none of
+    // its labels can be taken. Labels are only kept where they are strictly the best. The
+    // profiles are scratch data in the workspace arena, which the scans above have reset.
+    ArenaVector<ProfileLabel> labels(ws.arena);
+    ArenaVector<ArenaVector<ProfilePiece> > pieces(node_ids.size(), ArenaVector<ProfilePiece>(ws.arena), ws.arena);
+    labels.push_back({MAX_SIZE, 0, std::numeric_limits<int>::min(), NO_INDEX, NO_INDEX});
+    pieces[dst].push_back({0, std::numeric_limits<int>::min(), MAX_SIZE, 0, std::numeric_limits<int>::min()});
+    // labels that became the best somewhere, and the first and last departures they are best at
+    ArenaVector<ProfilePiece> replay(ws.arena);
+    ArenaVector<ProfilePiece> merged(ws.arena);
+
+    // Adds label to the profile of vertex u wherever it arrives strictly earlier. Two labels
+    // arrive at max(t + duration, earliest_arrival) at t, so the one that takes less time is
+    // strictly earlier on a suffix of the departures both can be taken at, and the other one
+    // on a prefix.
+    auto insert = [&](uint32_t u, const ProfileLabel &label) {
+        ArenaVector<ProfilePiece> &profile_pieces = pieces[u];
+        const uint32_t l = labels.size();
+        const int hi = label.latest_departure;
+        // the profile does not decrease, and label is never earlier than its earliest arrival
+        std::size_t begin = std::lower_bound(profile_pieces.begin(), profile_pieces.end(), label.earliest_arrival,
+            [](const ProfilePiece &piece, int time) {
+                return profile_arrival(piece, piece.last) <= time;
+            }) - profile_pieces.begin();
+        std::size_t end = begin;
+        int t = reached[u];
+        if (begin != profile_pieces.size()) {
+            t = std::max(t, profile_pieces[begin].first);
+        } else if (!profile_pieces.empty()) {
+            t = std::max(t, profile_pieces.back().last + 1);
+        }
+        ProfilePiece won = { l, MAX_SIZE, std::numeric_limits<int>::min(), label.duration, label.earliest_arrival };
+        merged.clear();
+        auto add = [&](const ProfilePiece &piece, int first, int last) {
+            if (first > last) {
+                return;
+            }
+            if (!merged.empty() && merged.back().label == piece.label && merged.back().last + 1 == first) {
+                merged.back().last = last;
+            } else {
+                merged.push_back({piece.label, first, last, piece.duration, piece.earliest_arrival});
+            }
+            if (piece.label == l) {
+                won.first = std::min(won.first, first);
+                won.last = std::max(won.last, last);
+            }
+        };
+        while (t <= hi) {
+            if (end == profile_pieces.size() || profile_pieces[end].first > t) {
+                const int gap_last = end == profile_pieces.size() ? hi : std::min(hi, profile_pieces[end].first - 1);
+                add(won, t, gap_last);
+                t = gap_last + 1;
+                continue;
+            }
+            const ProfilePiece best = profile_pieces[end++];
+            const int last = std::min(best.last, hi);
+            add(best, best.first, t - 1);
+            // Departures from t to last where label is strictly earlier: while best waits for
+            // a contact that starts after label arrives, and once best travels longer and
+            // arrives after label's earliest arrival.
+            int first_won = t, last_won = last;
+            if (label.duration < best.duration) {
+                if (best.earliest_arrival <= label.earliest_arrival) {
+                    first_won = std::max(t, label.earliest_arrival - best.duration + 1);
+                }
+            } else if (best.earliest_arrival > label.earliest_arrival) {
+                last_won = std::min(last, best.earliest_arrival - label.duration - 1);
+            } else {
+                last_won = t - 1;
+            }
+            add(best, t, std::min(first_won - 1, last));
+            add(won, first_won, last_won);
+            add(best, std::max(last_won + 1, t), best.last);
+            t = best.last + 1;
+        }
+        if (won.first > won.last) {
+            return;
+        }
+        profile_pieces.erase(profile_pieces.begin() + begin, profile_pieces.begin() + end);
+        profile_pieces.insert(profile_pieces.begin() + begin, merged.begin(), merged.end());
+        labels.push_back(label);
+        replay.push_back(won);
+    };
+
+    // Extends label l of the receiving vertex of contact c to the sending vertex, for the data
+    // that arrives over c by last_arrival. The label is the best way on from there only until
+    // then, and whatever is the best way on later is extended too.
+    auto extend = [&](uint32_t c, uint32_t l, int last_arrival) {
+        const uint32_t u = frm[c];
+        const ProfileLabel next = labels[l];
+        const int owlt = contacts.owlt[c];
+        last_arrival = std::min(last_arrival, next.latest_departure);
+        if (contacts.start[c] + owlt > last_arrival) {
+            return;
+        }
+        ProfileLabel label;
+        label.latest_departure = std::min(contacts.end[c] - 1, last_arrival - owlt);
+        label.duration = next.duration + owlt;
+        // The label only matters from reached[u] on, when it arrives at earliest_arrival at
+        // best, and until it would arrive after latest_arrival.
+        label.earliest_arrival = std::max(std::max(contacts.start[c] + owlt + next.duration, next.earliest_arrival),
+            reached[u] + label.duration);
+        label.contact = c;
+        label.next = l;
+        if (label.latest_departure < reached[u] || label.earliest_arrival > latest_arrival) {
+            return;
+        }
+        label.latest_departure = std::min(label.latest_departure, latest_arrival - label.duration);
+        insert(u, label);
+    };
+    // Whether data sent in the window can take contact c, and if so the times it can reach the
+    // receiving vertex over c at
+    auto arrivals = [&](uint32_t c, int &first_arrival, int &last_arrival) {
+        const uint32_t u = frm[c];
+        if (u == dst || u == to[c] || MAX_SIZE == reached[u] || reached[u] >= contacts.end[c]) {
+            return false;
+        }
+        first_arrival = std::max(contacts.start[c], reached[u]) + contacts.owlt[c];
+        last_arrival = std::min(contacts.end[c] - 1 + contacts.owlt[c], latest_arrival);
+        return first_arrival <= last_arrival;
+    };
+
+    // Contacts that start after latest_arrival cannot deliver by then, and those that start
+    // more than max_duration before first_departure are over by then. A contact extends the
+    // labels that are the best way on from its receiving vertex at some time data sent over it
+    // arrives there.
+    const int64_t first_start = static_cast<int64_t>(first_departure) - max_duration;
+    const uint32_t first = std::lower_bound(contacts.start.begin(), contacts.start.end(), first_start,
+        [](int start, int64_t time) { return start < time; }) - contacts.start.begin();
+    const uint32_t last = std::upper_bound(contacts.start.begin(), contacts.start.end(), latest_arrival)
+        - contacts.start.begin();
+    for (uint32_t c = last; c-- > first; ) {
+        int first_arrival, last_arrival;
+        if (arrivals(c, first_arrival, last_arrival)) {
+            const ArenaVector<ProfilePiece> &ways_on = pieces[to[c]];
+            std::size_t k = std::lower_bound(ways_on.begin(), ways_on.end(), first_arrival,
+                [](const ProfilePiece &piece, int time) { return piece.last < time; }) - ways_on.begin();
+            // extending c only changes the profile of its sending vertex
+            for (; k < ways_on.size() && ways_on[k].first <= last_arrival; ++k) {
+                extend(c, ways_on[k].label, std::min(ways_on[k].last, last_arrival));
+            }
+        }
+        // A label that became the best way on somewhere is extended over the contacts scanned
+        // before it that data can arrive over meanwhile.
+        while (!replay.empty()) {
+            const ProfilePiece won = replay.back();
+            replay.pop_back();
+            const uint32_t v = frm[labels[won.label].contact];
+            const uint32_t *first_in = in_contacts.data() + in_offsets[v];
+            const uint32_t *last_in = in_contacts.data() + in_offsets[v + 1];
+            // in contacts are in scan order, so the scanned ones are those from c to last
+            first_in = std::lower_bound(first_in, last_in, c);
+            last_in = std::lower_bound(first_in, last_in, last);
+            last_in = std::upper_bound(first_in, last_in, won.last,
+                [this](int time, uint32_t in) { return time < contacts.start[in]; });
+            for (const uint32_t *in = first_in; in != last_in; ++in) {
+                if (arrivals(*in, first_arrival, last_arrival) && first_arrival <= won.last && last_arrival >= won.first) {
+                    extend(*in, won.label, std::min(won.last, last_arrival));
+                }
+            }
+        }
+    }
+
+    // The source's profile over the window
+    profile.pieces.reserve(std::upper_bound(pieces[src].begin(), pieces[src].end(), last_departure,
+        [](int time, const ProfilePiece &piece) { return time < piece.first; }) - pieces[src].begin());
+    for (const ProfilePiece &source_piece : pieces[src]) {
+        if (source_piece.first > last_departure) {
+            break;
+        }
+        const ProfileLabel &label = labels[source_piece.label];
+        ArrivalProfile::Piece piece;
+        piece.first_departure = source_piece.first;
+        piece.last_departure = std::min(source_piece.last, last_departure);
+        piece.duration = label.duration;
+        piece.earliest_arrival = label.earliest_arrival;
+        piece.route = Route(contacts.contact(label.contact));
+        for (uint32_t l = label.next; NO_INDEX != labels[l].contact; l = labels[l].next) {
+            piece.route.append(contacts.contact(labels[l].contact));
+        }
+        profile.pieces.push_back(piece);
+    }
+    return profile;
+}
+
+int ArrivalProfile::arrival_time(int departure) const {
+    std::vector<Piece>::const_iterator it = std::lower_bound(pieces.begin(), pieces.end(), departure,
+        [](const Piece &piece, int time) { return piece.last_departure < time; });
+    if (it == pieces.end() || it->first_departure > departure) {
+        return MAX_SIZE;
+    }
+    return std::max(departure + it->duration, it->earliest_arrival);
+}
+
+Route ArrivalProfile::route(int departure) const {
+    std::vector<Piece>::const_iterator it = std::lower_bound(pieces.begin(), pieces.end(), departure,
+        [](const Piece &piece, int time) { return piece.last_departure < time; });
+    if (it == pieces.end() || it->first_departure > departure) {
+        return Route();
+    }
+    return it->route;
+}
+
+/*
+ * Contact graph routing route-finding algorithm over the contact plan.
+ * This builds a ContactGraph for a single query. Callers that route repeatedly over
+ * the same contact plan should keep a ContactGraph instead.
+ */
+Route dijkstra(Contact *root_contact, nodeId_t destination, const std::vector<Contact> &contact_plan) {
+    ContactGraph graph(contact_plan);
+    return graph.dijkstra(root_contact, destination);
+}
+
+/*
+ * Helper functions
+ */
+template <typename T>
+bool vector_contains(const std::vector<T> &vec, const T &ele) {
+    typename std::vector<T>::const_iterator it = std::find(vec.begin(), vec.end(), ele);
+    return it != std::end(vec);
+}
+
+// Throw this exception in methods that would otherwise try to access an empty container
+// E.g. calling std::vector::back() on an empty vector is undefined behavior.
+// Following the approach of the Python version CGR library, we use this class for Route::eligible()
+// as a substitue for Python's IndexError
+const char* EmptyContainerError::what() const throw() {
+    return "Tried to access element of an empty container";
+}
+
+std::ostream& operator<<(std::ostream &out, const std::vector<Contact> &obj) {
+    out << "[";
+    for (int i = 0; i < obj.size()-1; i++) {
+        out << obj[i] << ", ";
+    }
+    out << obj[obj.size()-1] << "]";
+
+    return out;
+}
+
+std::ostream& operator<<(std::ostream &out, const Contact &obj) {
+    static const boost::format fmtTemplate("%d->%d(%d-%d,d%d)[mav%.0f%%]");
+    boost::format fmt(fmtTemplate);
+
+    int min_vol = *std::min_element(obj.mav.begin(), obj.mav.end());
+    double volume = 100.0 * min_vol / obj.volume;
+    fmt % obj.frm % obj.to % obj.start % obj.end % obj.owlt % volume;
+    const std::string message(std::move(fmt.str()));
+
+    out << message;
+    return out;
+}
+
+std::ostream& operator<<(std::ostream &out, const Route &obj) {
+    static const boost::format fmtTemplate("to:%d|via:%d(%03d,%03d)|bdt:%d|hops:%d|vol:%d|conf:%.1f|%s");
+    boost::format fmt(fmtTemplate);
+
+    std::vector<Contact> routeHops = obj.get_hops();
+
+    fmt % obj.to_node % obj.next_node % obj.from_time % obj.to_time % obj.best_delivery_time
+        % routeHops.size() % obj.volume % obj.confidence % routeHops;
+    const std::string message(std::move(fmt.str()));
+
+    out << message;
+    return out;
+}
+
+
+
+/*
+ * Multigraph routing route-finding algorithm. Finds the shortest (least amount of time) path
+ * to transfer data throughout a network of nodes connected by temporary contacts.
+ * root_contact is a contact from the source node to the source node, and it's start time is when data first arrives to the source node
+ * destination is the nodeID_t of the destination node
+ * contact_plan is a vector of contacts that is used to construct the contact multigraph
+ *
+ * This builds a MultigraphRouter for a single query. Callers that route repeatedly over
+ * the same contact plan should keep a MultigraphRouter instead.
+ */
+Route cmr_dijkstra(Contact* root_contact, nodeId_t destination, const std::vector<Contact> &contact_plan) {
+    MultigraphRouter router(contact_plan);
+    return router.route(root_contact->frm, destination, root_contact->start);
+}
+
 
 } // namespace cgr
@@ -1,11 +1,21 @@
 #ifndef LIB_CGR_H
 #define LIB_CGR_H
 
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <ostream>
+#include <stdexcept>
+#include <string>
 #include <limits>
+#include <cstdint>
 //#include "cgr_lib_export.h"
 
 namespace cgr {
@@ -20,10 +30,10 @@ public:
     nodeId_t frm, to;
     int start, end, rate, volume;
     int owlt;
-    // int id = -1;
+    int id;
     float confidence;
     // Variable parameters
-    std::vector<int> mav;
+    std::array<int, 3> mav;
     // Route search working area
     int arrival_time;
     bool visited;
@@ -38,77 +48,902 @@ public:
     Contact(nodeId_t frm, nodeId_t to, int start, int end, int rate, float confidence=1, int owlt=1);
     Contact();
     ~Contact();
-    bool operator==(const Contact) const;
-    bool operator!=(const Contact) const;
+    bool operator==(const Contact&) const;
+    bool operator!=(const Contact&) const;
     friend std::ostream& operator<<(std::ostream&, const Contact&);
 };
 
 
+// Contact that repeats with a fixed period, such as a satellite pass over a ground station.
+// Occurrence i is `contact` shifted by i * period. Occurrences must not overlap, so the period
+// is at least the contact's duration.
+class PeriodicContact {
+public:
+    // first occurrence
+    Contact contact;
+    int period, count;
+    // `count` occurrences; throws std::invalid_argument if count < 1, occurrences overlap or
+    // the last occurrence ends after the largest int time
+    PeriodicContact(const Contact &contact, int period, int count);
+    // the occurrences that end by time `until`
+    static PeriodicContact until(const Contact &contact, int period, int until);
+    Contact occurrence(int i) const;
+    // end of the last occurrence, computed in 64 bits so that it cannot overflow
+    int64_t last_end() const;
+    // every occurrence as a separate contact, for routines that need a plain contact plan
+    std::vector<Contact> occurrences() const;
+};
+
+
+// Immutable contact plan data in struct-of-arrays form. Entry i of every column belongs to
+// contact i. Route search and route management working areas are not stored here; searches
+// keep them in their own per-query arrays indexed by contact index.
+class ContactStore {
+public:
+    std::vector<nodeId_t> frm, to;
+    std::vector<int> start, end, owlt, rate, id;
+    std::vector<float> confidence;
+    uint32_t size() const;
+    void reserve(uint32_t n);
+    void push_back(const Contact &contact);
+    // Contact i as a Contact object with cleared working areas
+    Contact contact(uint32_t i) const;
+};
+
+
+// Route: a sequence of contacts and its metrics. Hops are kept in immutable nodes linked back
+// to the previous hop and shared between routes, so copying a route or extending a copy (as
+// route families that share a prefix do) copies no contacts, and append() updates the metrics
+// in O(1) amortised instead of recomputing them over every hop.
 class Route {
 public:
     nodeId_t to_node, next_node;
     int from_time, to_time, best_delivery_time, volume;
     float confidence;
+    // Route starting with contact, or parent extended by contact; parent is not referenced afterwards
     Route(Contact, Route *parent=NULL);
     Route();
     ~Route();
 private:
-    Route *parent;
-    std::vector<Contact> hops;
-    std::map<nodeId_t, bool> __visited;
+    struct Hop;
+    struct VolumeGroup;
+    std::shared_ptr<const Hop> last;
+    // Hops whose effective stop time (the earliest end of them and their successors) is the
+    // same form one group; the route volume is the smallest group limit.
+    std::shared_ptr<const VolumeGroup> volume_groups;
 public:
     Contact get_last_contact();
+    bool empty() const;
     bool visited(nodeId_t node);
     void append(Contact contact);
+    // Recomputes the metrics from the hops; append() keeps them up to date already
     void refresh_metrics();
     bool eligible(Contact contact);
-    std::vector<Contact> get_hops();
+    std::vector<Contact> get_hops() const;
 };
 
 
-// Vertex for Multigraph Routing
+// Index value used by the multigraph for "no vertex" / "no contact"
+const uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+// Multigraph contact indices with this bit set refer to an occurrence of a periodic contact
+const uint32_t OCCURRENCE = 0x80000000;
+
+
+// Vertex for Multigraph Routing. This is the route search working area of one vertex;
+// the router keeps one per dense vertex index in a contiguous vector.
 class Vertex {
 public:
     nodeId_t id;
-    // mapping between the ID of the vertex that can be reached and a list of every contact 
-    // connecting this vertex to the vertex that can be reached, sorted by contact's arrival time
-    std::unordered_map<nodeId_t, std::vector<Contact>> adjacencies; 
     int arrival_time;
     bool visited;
-    Contact *predecessor;
+    // index in the ContactMultigraph of the contact used to reach this vertex
+    uint32_t predecessor;
     Vertex(nodeId_t id);
     Vertex();
     bool operator<(const Vertex& v) const; // comparison operator to order in priority queue
 };
 
 
+// Read-only view of a contiguous array. The elements are owned elsewhere, either by a
+// std::vector or by a memory mapped file, and must outlive the view.
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() : ptr(NULL), n(0) {}
+    ArrayView(const T *ptr, uint32_t n) : ptr(ptr), n(n) {}
+    ArrayView(const std::vector<T> &v) : ptr(v.data()), n(v.size()) {}
+    const T& operator[](uint32_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + n; }
+    uint32_t size() const { return n; }
+    bool empty() const { return 0 == n; }
+private:
+    const T *ptr;
+    uint32_t n;
+};
+
+
+// Monotonic memory arena for scratch data that is all freed at once, such as the working data
+// of one route search. Allocating bumps a pointer through a block, freeing single allocations
+// does nothing, and reset() frees everything in O(1) by rewinding to the start of the block.
+// If the block ran out since the last reset, reset() replaces the blocks by one big enough
+// for all of them, so a workload of steady size stops allocating after its first runs.
+class Arena {
+public:
+    explicit Arena(std::size_t initial_size = 4096);
+    // Copies start out empty: the contents are scratch data
+    Arena(const Arena &other);
+    Arena& operator=(const Arena &other);
+    void* allocate(std::size_t bytes, std::size_t alignment);
+    void reset();
+    // bytes reserved from the global heap
+    std::size_t capacity() const;
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+    std::vector<Block> blocks;
+    std::size_t initial_size;
+    // bytes used of the last block
+    std::size_t used;
+};
+
+// Standard allocator handing out memory from an Arena. Deallocation does nothing, so
+// containers using it must not be used after the arena is reset.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    ArenaAllocator(Arena &arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+    T* allocate(std::size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, std::size_t) {}
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+private:
+    template <typename U> friend class ArenaAllocator;
+    Arena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+// Read-only memory mapping of a whole file. Several processes mapping the same file
+// share its pages through the page cache.
+class MappedFile {
+public:
+    MappedFile(const std::string &filename);
+    ~MappedFile();
+    const char* data() const;
+    std::size_t size() const;
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+    const char *addr;
+    std::size_t length;
+#ifdef _WIN32
+    void *file_handle, *mapping_handle;
+#endif
+};
+
+
+// Contact multigraph in compressed sparse row (CSR) form.
+// Node ids are remapped to dense vertex indices 0..num_vertices()-1, assigned in increasing
+// node id order, so node_ids is sorted. The (from, to) pairs leaving vertex v are
+// [adj_offsets[v], adj_offsets[v+1]), pair p goes from vertex pair_frm[p] to vertex pair_to[p],
+// and the contacts of pair p are [pair_offsets[p], pair_offsets[p+1]), sorted by start time.
+// Contacts are referenced by that index into the contact columns; plan_index maps it back
+// to the contact's position in the original contact plan.
+//
+// Contacts of one pair may overlap, as with several antennas or a rate change mid-pass. The
+// best contact of a pair for data ready at time t is the one that delivers it earliest,
+// max(start, t) + owlt, out of those that end after t. As t grows that choice changes at most
+// a few times per contact start or end, so each pair keeps its lower envelope: a sorted list of
+// time bounds and the best contact up to each bound, built by one sweep over the pair's
+// contacts. contact_search() finds its answer in the envelope by binary search. A pair whose
+// contacts do not overlap and arrive in start order has the contacts themselves as envelope,
+// bounded by their end times, and stores nothing extra.
+//
+// The arrays are views. A multigraph built from a contact plan owns the storage behind
+// them; a multigraph opened from a binary contact plan (see cp_save_binary) points them
+// straight into the memory mapped file, so opening it allocates nothing per contact.
+//
+// The plan can be updated in place (add_contact, remove_contact, set_rate, set_end).
+// Updates never move contacts in the columns. The first update of a pair copies its contact
+// indices into a time-sorted list of its own, kept apart from the CSR range; an added contact
+// is appended to the columns and inserted into that list, a removed one is dropped from it.
+// The pair accessors below (contact_pair, find_contact, contact_search) see the updated lists
+// and envelopes; code should not walk pair_offsets directly once the plan has been updated.
+// Only a contact between nodes that had no pair yet makes the multigraph rebuild itself from
+// its current contacts, which renumbers them. Every update increments version().
+//
+// A long-running router moves the multigraph's time window forward with advance(now). A
+// contact that ended at or before now() can no longer carry data, and no contact search for a
+// time at or after now() returns it. Searches start at the first envelope segment that has not
+// expired, and advance() only visits the pairs whose next contact or segment expires by now,
+// taken from a min-heap keyed on that time. Once expired and removed contacts outnumber live
+// ones, the multigraph compacts itself by rebuilding from its live contacts, so memory and search work
+// follow the plan's remaining horizon rather than its whole span.
+//
+// Periodic contacts (PeriodicContact) are stored once per descriptor, in each pair next to its
+// other contacts, and never per occurrence. contact_search() computes the occurrence it needs
+// from the period and returns it as OCCURRENCE | n, where n numbers the occurrences of all
+// periodic contacts; such an index is not a position in the contact columns, so the times of
+// any contact are read with contact_start(), contact_end() and contact_owlt(). The occurrences
+// of one periodic contact do not overlap each other, but may overlap any other contact of the
+// pair. Plan updates apply to stored contacts only: an occurrence cannot be removed or changed.
 class ContactMultigraph {
 public:
-    std::unordered_map<nodeId_t, Vertex*> vertices;
-    ContactMultigraph(std::vector<Contact> contact_plan, nodeId_t dest_id);
+    ArrayView<nodeId_t> node_ids;
+    ArrayView<uint32_t> adj_offsets;
+    ArrayView<uint32_t> pair_frm;
+    ArrayView<uint32_t> pair_to;
+    ArrayView<uint32_t> pair_offsets;
+    // fixed parameters of the stored contacts, one column per parameter
+    ArrayView<int> start, end, owlt, rate, id;
+    ArrayView<float> confidence;
+    ArrayView<uint32_t> plan_index;
+    ContactMultigraph(const std::vector<Contact> &contact_plan, nodeId_t dest_id);
+    ContactMultigraph(const std::vector<Contact> &contact_plan);
+    ContactMultigraph(const std::vector<Contact> &contact_plan, const std::vector<PeriodicContact> &periodic_contacts);
+    // Maps a binary contact plan file written by cp_save_binary()
+    explicit ContactMultigraph(const std::string &binary_filename);
+    uint32_t num_vertices() const;
+    // number of stored contacts, the size of the contact columns
+    uint32_t num_contacts() const;
+    uint32_t num_periodic_contacts() const;
+    // dense index of node `id`, or NO_INDEX if the node is not in the multigraph
+    uint32_t vertex_index(nodeId_t id) const;
+    // index of the pair that contact `contact` belongs to
+    uint32_t contact_pair(uint32_t contact) const;
+    // index of the contact with the same from, to, start and end as `contact`, or NO_INDEX
+    uint32_t find_contact(const Contact &contact) const;
+    // contact `contact` as a Contact object with cleared working areas
+    Contact contact(uint32_t contact) const;
+    // times of contact `contact`, stored or an occurrence
+    int contact_start(uint32_t contact) const;
+    int contact_end(uint32_t contact) const;
+    int contact_owlt(uint32_t contact) const;
+    // Route over the given contacts, in order
+    Route make_route(ArrayView<uint32_t> contacts) const;
+    // index of the contact of pair `pair` that delivers data ready at arrival_time earliest,
+    // or NO_INDEX if every contact of the pair has ended by then. Ties go to the contact that
+    // starts first. O(log n) in the pair's contacts, plus one step per periodic contact.
+    uint32_t contact_search(uint32_t pair, int arrival_time) const;
+    // As above, out of the contacts not in `excluded` (sorted). If the best contact is excluded
+    // the contacts that could be open at arrival_time or start before the best arrival so far
+    // are compared one by one: those starting at most the pair's longest contact duration
+    // before arrival_time, found by binary search.
+    uint32_t contact_search(uint32_t pair, int arrival_time, const std::vector<uint32_t> &excluded) const;
+    // Builds the contact search index of every pair with at least min_contacts envelope bounds,
+    // or drops the index if min_contacts is NO_INDEX. An indexed pair has a table of fixed-width
+    // time buckets over its bounds, about four bounds per bucket, holding the number of bounds
+    // at or before each bucket; contact_search() then reads one table entry and searches the
+    // few bounds of one bucket instead of the whole pair. Multigraphs built from a contact plan
+    // index pairs of 32 or more contacts and keep the setting across rebuilds; a memory mapped
+    // multigraph is not indexed unless this is called.
+    void build_search_index(uint32_t min_contacts);
+
+    // Contact plan updates. Contacts are identified as in find_contact(). The multigraph
+    // must not be searched while it is updated. A contact that would not end after it starts
+    // throws std::invalid_argument; updates of contacts that are not in the multigraph return
+    // false. A memory mapped multigraph copies its arrays on the first update.
+    void add_contact(const Contact &contact);
+    bool remove_contact(const Contact &contact);
+    bool set_rate(const Contact &contact, int rate);
+    bool set_end(const Contact &contact, int end);
+    // Moves the time window forward to `now`; route queries must start at or after now().
+    // Skipping expired contacts does not change such queries, so only a compaction, which
+    // renumbers contacts, counts as an update. Moving the window backwards does nothing.
+    void advance(int now);
+    // start of the time window, std::numeric_limits<int>::min() until the first advance()
+    int now() const;
+    // number of updates applied since the multigraph was built or mapped
+    uint64_t version() const;
+    // number of updates that rebuilt the multigraph, renumbering vertices, pairs and contacts
+    uint64_t rebuilds() const;
+private:
+    // saves the envelopes along with the public arrays
+    friend void cp_save_binary(const std::vector<Contact> &contact_plan, std::string filename);
+    ContactMultigraph(const ContactMultigraph&);
+    ContactMultigraph& operator=(const ContactMultigraph&);
+    // Storage behind the views when the multigraph is built from a contact plan
+    struct Storage {
+        std::vector<nodeId_t> node_ids;
+        std::vector<uint32_t> adj_offsets, pair_frm, pair_to, pair_offsets;
+        std::vector<int> start, end, owlt, rate, id;
+        std::vector<float> confidence;
+        std::vector<uint32_t> plan_index;
+        std::vector<uint32_t> envelope_offsets, envelope_contact;
+        std::vector<int> envelope_bound, longest_contact;
+    };
+    Storage storage;
+    std::shared_ptr<const MappedFile> mapping;
+    // Update state. The contacts of the CSR ranges are [0, pair_offsets[num_pairs]); contact
+    // pair_offsets[num_pairs] + i was added by an update to pair added_pair[i]. An updated
+    // pair's contacts, sorted by start time, are pair_lists[pair] instead of its CSR range,
+    // its envelope is pair_envelopes[pair] and its longest contact duration is
+    // updated_longest[pair]; all are empty until the first update and then have an entry per pair.
+    std::vector<uint32_t> added_pair;
+    std::vector<std::vector<uint32_t>> pair_lists;
+    std::vector<char> pair_updated;
+    // Segment of a pair's lower envelope: `contact` is the best one for times before `bound`
+    // and at or after the previous segment's bound
+    struct EnvelopeSegment {
+        int bound;
+        uint32_t contact;
+    };
+    std::vector<std::vector<EnvelopeSegment>> pair_envelopes;
+    std::vector<int> updated_longest;
+    uint64_t updates, num_rebuilds;
+    // Periodic contacts, sorted by pair and start time: those of pair p are
+    // [periodic_offsets[p], periodic_offsets[p+1]), and the occurrences of periodic contact d
+    // are numbered from periodic_first[d]. Empty for a memory mapped multigraph.
+    struct Periodic {
+        std::vector<uint32_t> offsets, pair, first;
+        std::vector<int> start, end, owlt, rate, id, period;
+        std::vector<float> confidence;
+    };
+    Periodic periodic;
+    // Lower envelopes of the CSR pairs. Pair p's segments are envelope_bound/envelope_contact
+    // [envelope_offsets[p], envelope_offsets[p+1]); none if its contacts are their own
+    // envelope, in which case its bounds are the contacts' end times. longest_contact[p] is
+    // the longest contact duration of pair p. Built with the CSR arrays and saved with them
+    // in binary contact plans.
+    ArrayView<uint32_t> envelope_offsets, envelope_contact;
+    ArrayView<int> envelope_bound, longest_contact;
+    // Builds the envelopes and longest contacts of all CSR pairs into the storage
+    void build_envelopes();
+    // longest contact duration of pair `pair`; a contact open at time t started after t minus it
+    int pair_longest(uint32_t pair) const;
+    // Lower envelope of the current contacts of pair `pair`, with scratch memory from `scratch`
+    void pair_envelope(uint32_t pair, Arena &scratch, std::vector<EnvelopeSegment> &segments) const;
+    // the envelope bounds of CSR pair `pair` and their number
+    const int* pair_bounds(uint32_t pair, uint32_t &size) const;
+    // Contact search index. The buckets of pair p are search_buckets[search_offsets[p] ..
+    // search_offsets[p+1]), none if the pair is not indexed. Bucket b starts at time
+    // search_origin[p] + (b << search_shift[p]) and holds the number of the pair's envelope
+    // bounds at or before that time; the last entry closes the last bucket.
+    uint32_t search_min_contacts;
+    std::vector<uint32_t> search_offsets, search_buckets;
+    std::vector<int> search_origin;
+    std::vector<uint8_t> search_shift;
+    // Fills the buckets of indexed pair `pair` from its envelope bounds
+    void fill_search_buckets(uint32_t pair);
+    // number of the envelope bounds of CSR pair `pair` at or before `time`, which is the
+    // envelope segment `time` falls in
+    uint32_t search_position(uint32_t pair, int time) const;
+    // Time window. pair_first[pair] is the number of contacts at the start of the pair that
+    // all ended by window_start, and segment_first[pair] the number of its envelope segments
+    // that ended by then; num_expired sums pair_first. expiry is a min-heap of (time, pair) for
+    // the time the pair's next contact or segment expires, which is expiry_time[pair]; entries
+    // that no longer match it are stale. All are empty until the window first advances.
+    int window_start;
+    std::vector<uint32_t> pair_first, segment_first;
+    std::vector<std::pair<int, uint32_t>> expiry;
+    std::vector<int> expiry_time;
+    uint32_t num_expired;
+    // contacts removed by updates since the multigraph was built or mapped
+    uint32_t num_removed;
+    // Moves pair_first and segment_first of `pair` past what ended by window_start and
+    // schedules the pair's next expiry
+    void expire_pair(uint32_t pair);
+    void build(const std::vector<Contact> &contact_plan, const std::vector<PeriodicContact> &periodic_contacts,
+               const std::vector<nodeId_t> &extra_nodes);
+    void map(const std::string &binary_filename);
+    // Points the views at the storage
+    void attach();
+    // Copies mapped arrays into the storage so they can be updated
+    void own();
+    // Rebuilds the multigraph from its live contacts and `contact`, if one is given
+    void rebuild(const Contact *contact);
+    // number of contacts of pair `pair` and the i-th of them in start time order
+    uint32_t pair_size(uint32_t pair) const;
+    uint32_t pair_contact(uint32_t pair, uint32_t i) const;
+    // position in its pair of a contact that matches `contact`, or NO_INDEX, and the pair
+    uint32_t find_position(const Contact &contact, uint32_t &pair) const;
+    // Gives pair `pair` its own contact list so that it can be updated
+    std::vector<uint32_t>& update_pair(uint32_t pair);
+    // Recomputes the envelope and pair_first[pair] of updated pair `pair`
+    void refresh_pair(uint32_t pair);
+    // periodic contact of occurrence `contact` and the occurrence's number within it
+    uint32_t occurrence_of(uint32_t contact, int &i) const;
+    // Earliest arriving contact for data ready at `time` out of `found` (a stored contact of
+    // pair `pair`, or NO_INDEX) and, per periodic contact of the pair, its first occurrence
+    // that ends after `time`
+    uint32_t earliest_occurrence(uint32_t pair, int time, uint32_t found) const;
+};
+
+
+// Entry of the multigraph routing priority queue. The arrival time is copied into the entry
+// so that lowering a vertex's arrival time after it was pushed ("lazy deletion") cannot
+// break the heap order. The contact graph search queues contacts, with the contact index
+// as the vertex.
+struct QueueEntry {
+    int arrival_time;
+    uint32_t vertex;
 };
 
 
-// Comparator for priority queue in multigraph routing
+// Comparator for the routing priority queues: earlier arrival first, then lower index
 class CompareArrivals
 {
 public:
-    bool operator()(const Vertex* v1, const Vertex* v2);
+    bool operator()(const QueueEntry &e1, const QueueEntry &e2) const;
 };
 
 
-    int contact_search_index(std::vector<Contact> &contacts, int arrival_time);
-    Contact* contact_search_predecessor(std::vector<Contact>& contacts, int arrival_time);
+// Monotone radix heap of QueueEntry for integer arrival times. An entry must not arrive
+// earlier than the last entry popped, which holds in an earliest arrival search because data
+// never arrives over a contact before it was sent. Entries are spread over 33 buckets by the
+// highest bit in which their arrival time differs from the last minimum; bucket 0 holds the
+// entries equal to it, as a heap so that they pop in CompareArrivals order (lower vertex first).
+// Each entry is moved to a lower bucket at most 32 times.
+class RadixQueue {
+public:
+    RadixQueue();
+    bool empty() const;
+    void push(const QueueEntry &entry);
+    const QueueEntry& top();
+    void pop();
+    void clear();
+private:
+    uint32_t last;
+    std::size_t count;
+    std::array<std::vector<QueueEntry>, 33> buckets;
+    unsigned bucket(uint32_t key) const;
+    // Refills bucket 0 from the first non-empty bucket if it is empty
+    void refill();
+};
+
+
+// Binary heap of QueueEntry in CompareArrivals order. Unlike std::priority_queue it keeps
+// its storage when cleared, so a reused workspace does not allocate per search.
+class BinaryQueue {
+public:
+    bool empty() const;
+    void push(const QueueEntry &entry);
+    const QueueEntry& top() const;
+    void pop();
+    void clear();
+private:
+    std::vector<QueueEntry> heap;
+};
+
+
+// 4-ary heap of QueueEntry in CompareArrivals order holding at most one entry per vertex.
+// position[v] is where vertex v's entry is, so decrease() can move it up in place
+// (decrease-key). Like BinaryQueue it keeps its storage when cleared.
+class IndexedQueue {
+public:
+    // Sizes the position index for vertices [0, num_vertices)
+    void resize(uint32_t num_vertices);
+    bool empty() const;
+    // entry.vertex must not be queued
+    void push(const QueueEntry &entry);
+    // entry.vertex must be queued with a later or equal arrival time
+    void decrease(const QueueEntry &entry);
+    const QueueEntry& top() const;
+    void pop();
+    void clear();
+private:
+    std::vector<QueueEntry> heap;
+    std::vector<uint32_t> position;
+    void sift_up(uint32_t i, const QueueEntry &entry);
+    void sift_down(uint32_t i, const QueueEntry &entry);
+};
+
+
+// Route search working area of a multigraph search: one Vertex per dense vertex index and
+// the search's priority queue. All mutable search state lives here, never in the multigraph,
+// so threads can search one shared multigraph concurrently with a workspace each.
+// A workspace is sized for a multigraph on first use and then reused: preparing it for the
+// next search only resets the vertices the previous search touched, and the queues keep
+// their storage, so repeated searches do not allocate.
+class QueryWorkspace {
+public:
+    std::vector<Vertex> vertices;
+    // vertices whose working area was modified since the last prepare()
+    std::vector<uint32_t> touched;
+    BinaryQueue binary_queue;
+    RadixQueue radix_queue;
+    // scratch data of the current search, freed by prepare()
+    Arena arena;
+    void prepare(const ContactMultigraph &CM);
+    // Marks vertex v as already visited so the next search never enters it
+    void block(uint32_t v);
+};
+
+
+// Fixed-size pool of worker threads for running independent route searches in parallel.
+// The thread calling parallel_for() takes part in the work as worker 0.
+// Each parallel_for() splits its index range evenly between the workers. A worker runs its own
+// indices in order and, once they are used up, steals the back half of the remaining indices
+// of another worker, so tasks of very uneven cost still keep every worker busy.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned num_workers = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    // number of workers, including the calling thread
+    unsigned size() const;
+    // Runs task(i, worker) for every i in [0, n) and returns when all calls are done.
+    // worker is in [0, size()) and no two concurrent calls share a worker index, so it can be
+    // used to pick per-worker scratch state. The first exception thrown by a task is rethrown.
+    void parallel_for(uint32_t n, const std::function<void(uint32_t, unsigned)> &task);
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_ready, work_done;
+    const std::function<void(uint32_t, unsigned)> *job;
+    uint64_t generation;
+    // indices [begin, end) of the current job not yet taken by or stolen from a worker
+    struct WorkRange {
+        std::mutex mutex;
+        uint32_t begin, end;
+    };
+    std::unique_ptr<WorkRange[]> ranges;
+    unsigned busy_workers;
+    std::exception_ptr error;
+    bool stopping;
+    void worker_loop(unsigned worker);
+    void run_job(unsigned worker);
+    // Takes the next index for worker from its own range, or by stealing; false if none is left
+    bool take(unsigned worker, uint32_t &index);
+};
+
+
+// Earliest arrival tree of a one-to-all multigraph search: for every vertex, the time data
+// from the source reaches it and the contact it arrives over. Routes to any reachable node
+// are extracted on demand. The tree refers to the router's multigraph and must not outlive it
+// or an update of its contact plan.
+class RouteTree {
+public:
+    RouteTree();
+    nodeId_t source() const;
+    int start_time() const;
+    bool reachable(nodeId_t node) const;
+    // earliest arrival time at node (start_time for the source), or MAX_SIZE if it cannot be reached
+    int arrival_time(nodeId_t node) const;
+    // Earliest arrival route from the source to destination; an empty Route if there is none
+    Route route(nodeId_t destination) const;
+private:
+    friend class MultigraphRouter;
+    const ContactMultigraph *CM;
+    nodeId_t source_node;
+    // dense index of the source, or NO_INDEX if it is not in the multigraph
+    uint32_t src;
+    int start;
+    // multigraph version the tree is current for
+    uint64_t version;
+    // indexed by dense vertex index
+    std::vector<int> arrival;
+    std::vector<uint32_t> predecessor;
+};
+
+
+// One route query: data ready at source at start_time, to be delivered to destination
+struct RouteQuery {
+    nodeId_t source, destination;
+    int start_time;
+};
+
+
+// Priority queue used by the multigraph search. Both pop vertices in the same order, earlier
+// arrival first and then lower vertex index, so they find the same routes.
+enum QueuePolicy {
+    // binary heap (BinaryQueue) with lazy deletion
+    BINARY_HEAP,
+    // monotone radix heap (RadixQueue) with lazy deletion
+    RADIX_HEAP
+};
+
+
+// Multigraph routing engine. The contact multigraph is built once from the contact plan
+// and then answers any number of route queries without copying or rebuilding the plan.
+// Only the vertices reached by a query are reset before the next one, so the cost of a
+// query scales with the part of the graph the search touches.
+//
+// The multigraph is immutable after construction. The const query methods keep all search
+// state in the QueryWorkspace they are given, so any number of threads may call them
+// concurrently on one router, each with its own workspace. The other query methods use
+// workspaces owned by the router and must not run concurrently.
+class MultigraphRouter {
+public:
+    MultigraphRouter(const std::vector<Contact> &contact_plan);
+    // Routes over a plan with periodic contacts, without materialising their occurrences
+    MultigraphRouter(const std::vector<Contact> &contact_plan, const std::vector<PeriodicContact> &periodic_contacts);
+    // Routes directly over a memory mapped binary contact plan written by cp_save_binary()
+    explicit MultigraphRouter(const std::string &binary_filename);
+    // Earliest arrival route from source to destination for data ready at source at start_time.
+    // Returns an empty Route (no hops) if destination cannot be reached.
+    Route route(nodeId_t source, nodeId_t destination, int start_time);
+    Route route(QueryWorkspace &ws, nodeId_t source, nodeId_t destination, int start_time) const;
+    // Answers every query and returns the routes in query order. The queries run on `pool`
+    // if one is given, each worker searching the shared multigraph with its own workspace.
+    std::vector<Route> route_batch(ArrayView<RouteQuery> queries, ThreadPool *pool = NULL);
+    // Earliest arrival tree from source to every vertex, from a single search run to completion
+    RouteTree route_tree(nodeId_t source, int start_time);
+    RouteTree route_tree(QueryWorkspace &ws, nodeId_t source, int start_time) const;
+    // Contact plan updates that keep `tree`, built by route_tree(), current. The update is
+    // applied to the multigraph and then only the part of the tree it affects is recomputed:
+    // a removal re-relaxes the subtree below the removed contact from its incoming pairs, an
+    // addition propagates improvements outwards from the new contact's receiving node.
+    // Arrival times match a full search; where several predecessors arrive equally early the
+    // repaired tree may keep a different one. The tree is recomputed with a full search if it
+    // was not current before the update, or if the update rebuilt the multigraph.
+    bool remove_contact(RouteTree &tree, const Contact &contact);
+    void add_contact(RouteTree &tree, const Contact &contact);
+    // Up to num_routes loopless routes from source to destination in order of arrival time,
+    // using Yen's algorithm over contacts. The spur searches of each iteration run on `pool`
+    // if one is given, otherwise on the calling thread.
+    std::vector<Route> yen(nodeId_t source, nodeId_t destination, int start_time, int num_routes,
+                           ThreadPool *pool = NULL);
+    const ContactMultigraph& graph() const;
+    // The multigraph for contact plan updates; no query may run during an update
+    ContactMultigraph& graph();
+    QueuePolicy queue_policy() const;
+    void set_queue_policy(QueuePolicy queue_policy);
+private:
+    ContactMultigraph CM;
+    QueuePolicy policy;
+    QueryWorkspace workspace;
+    // one workspace per ThreadPool worker for route_batch() and yen()'s spur searches
+    std::vector<QueryWorkspace> worker_workspaces;
+    // Earliest arrival search from src, starting at start_time, until dst is settled, or
+    // until every reachable vertex is settled if dst is NO_INDEX. Contacts in
+    // excluded_contacts (sorted) are never used. The workspace must have been prepared;
+    // vertices blocked in it are never entered. Returns true if dst was reached.
+    bool search(QueryWorkspace &ws, uint32_t src, uint32_t dst, int start_time,
+                const std::vector<uint32_t> &excluded_contacts) const;
+    template <typename Queue>
+    bool search_with(Queue &PQ, QueryWorkspace &ws, uint32_t src, uint32_t dst, int start_time,
+                     const std::vector<uint32_t> &excluded_contacts) const;
+    // Appends the contacts on the search tree path from src to dst, in order, to `contacts`
+    template <typename Allocator>
+    void path_contacts(const QueryWorkspace &ws, uint32_t src, uint32_t dst,
+                       std::vector<uint32_t, Allocator> &contacts) const;
+    // Reverse adjacency for tree repairs: the pairs into vertex v are
+    // in_pairs[in_offsets[v]..in_offsets[v+1]). Pairs only change when the multigraph is
+    // rebuilt, so the index is rebuilt when CM.rebuilds() changes.
+    std::vector<uint32_t> in_offsets, in_pairs;
+    uint64_t in_rebuilds;
+    void index_incoming_pairs();
+    // vertices of the subtree being repaired
+    std::vector<char> in_subtree;
+    // Recomputes tree's arrival times from the vertices queued in `workspace`, moving only
+    // vertices whose arrival time improves, and if `subtree` is given only vertices in it
+    void propagate(RouteTree &tree, bool subtree);
+};
+
+
+// Cache of earliest arrival routes in front of a MultigraphRouter, keyed by (source,
+// destination) and departure time. A route found for departure time t is stored with its
+// validity interval [t, latest departure that still arrives as early]: every departure in that
+// interval arrives no earlier than one at t, and the route still achieves that arrival, so
+// it is an earliest arrival route for all of them. "No route" found for t holds for every
+// later departure. Lookups search the intervals of the (source, destination) by departure time.
+// An insert drops the intervals the new one covers, so intervals that start later end later,
+// and the one starting last at or before a departure is the only one that can cover it.
+// Entries are dropped by expire() once their interval is over, and by invalidate() when a
+// contact they use is suppressed or its MAV is depleted. All entries are dropped when the
+// multigraph's version() shows the contact plan was updated. A cache is not thread safe; threads
+// sharing a router should keep a cache each.
+class RouteCache {
+public:
+    RouteCache(const MultigraphRouter &router);
+    // Earliest arrival route as MultigraphRouter::route(), served from the cache if possible
+    Route route(nodeId_t source, nodeId_t destination, int start_time);
+    // Drops every cached route that uses `contact`
+    void invalidate(const Contact &contact);
+    // Drops every cached route that is not valid for departures at or after `now`
+    void expire(int now);
+    void clear();
+    // number of cached routes
+    std::size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+private:
+    struct Entry {
+        int valid_until;
+        Route route;
+        // multigraph indices of the route's contacts, sorted
+        std::vector<uint32_t> contacts;
+    };
+    // cached routes from source to destination by start of validity interval
+    typedef std::map<int, Entry> Intervals;
+    const MultigraphRouter *router;
+    // multigraph version the entries were computed on
+    uint64_t version;
+    QueryWorkspace workspace;
+    std::map<std::pair<nodeId_t, nodeId_t>, Intervals> entries;
+    std::size_t num_entries;
+    uint64_t num_hits, num_misses;
+    // Stores entry as valid from start_time on, dropping the entries it covers
+    void insert(Intervals &intervals, int start_time, const Entry &entry);
+};
+
+
+// Route search working area of a contact graph search, one entry per contact plus one for
+// the root contact. Entries are stamped with a search epoch: an entry whose stamp is not the
+// current epoch counts as cleared, so starting a search costs nothing and a search only
+// touches the contacts it explores. Sized on first use and then reused without allocating.
+class ContactGraphWorkspace {
+public:
+    ContactGraphWorkspace();
+    uint32_t epoch;
+    std::vector<uint32_t> stamp;
+    std::vector<int> arrival_time;
+    std::vector<char> visited;
+    std::vector<uint32_t> predecessor;
+    // Nodes on the route to the contact being visited, per dense node index: node_mark[n] is
+    // node_epoch for exactly those nodes. Re-marked from the predecessor chain on every visit.
+    uint32_t node_epoch;
+    std::vector<uint32_t> node_mark;
+    // Contacts reached and not yet visited in the current search, keyed by arrival time with
+    // the lower contact index first on ties. Entries are updated in place (decrease-key).
+    IndexedQueue frontier;
+    // scratch data of the current search, freed by prepare()
+    Arena arena;
+    // Sizes the working area for num_contacts contacts and num_nodes nodes if needed and starts
+    // a new search epoch, clearing every entry only when the epoch wraps
+    void prepare(uint32_t num_contacts, uint32_t num_nodes);
+    // Starts a new set of marked nodes, clearing node_mark only when node_epoch wraps
+    void clear_nodes();
+    // Brings entry i into the current epoch, clearing it if it is stale
+    void touch(uint32_t i);
+};
+
+
+// Contact graph of a contact plan for repeated dijkstra() searches. The contact columns and
+// the neighbour index (contacts grouped by sending node) are built once per plan and never
+// change afterwards. Route management state (suppressed, mav, suppressed_next_hop) is read
+// from the plan during each search, so it may change between searches; the plan itself must
+// outlive the graph and keep its contacts in place.
+// The const dijkstra() keeps all search state in the workspace it is given, so threads may
+// search one graph concurrently with a workspace each, as long as none of them changes the
+// plan's route management state meanwhile.
+class ContactGraph {
+public:
+    ContactGraph(const std::vector<Contact> &contact_plan);
+    // Earliest arrival route from root_contact->to to destination, as the free dijkstra()
+    Route dijkstra(Contact *root_contact, nodeId_t destination);
+    Route dijkstra(ContactGraphWorkspace &ws, Contact *root_contact, nodeId_t destination) const;
+private:
+    const std::vector<Contact> *plan;
+    ContactStore contacts;
+    // neighbour index: the contacts sent by node node_ids[n] are
+    // adjacency[adj_offsets[n]..adj_offsets[n+1]), by end time and then in contact plan order,
+    // and adjacency_end holds their end times. The contacts still open at time t are the ones
+    // after the last to end by t, so they are found in O(log n) whether they overlap or not.
+    std::vector<nodeId_t> node_ids;
+    std::vector<uint32_t> adj_offsets, adjacency;
+    std::vector<int> adjacency_end;
+    // dense node index of each contact's receiving node
+    std::vector<uint32_t> receiver;
+    ContactGraphWorkspace workspace;
+};
+
+
+// Route search working area of a connection scan: per dense vertex index, the earliest arrival
+// time found and the contact it arrives over. Sized on first use; preparing it for the next
+// search only resets the vertices the previous search reached.
+class ConnectionScanWorkspace {
+public:
+    std::vector<int> arrival_time;
+    std::vector<uint32_t> predecessor;
+    // vertices reached since the last prepare()
+    std::vector<uint32_t> touched;
+    // vertices whose already scanned contacts must be relaxed again
+    std::vector<uint32_t> replay;
+    // scratch data of the current query, freed by prepare()
+    Arena arena;
+    void prepare(uint32_t num_vertices);
+};
+
+
+// Earliest arrival profile of a (source, destination) pair: for every departure time in a
+// window, when data sent then arrives and over which route. Departures in a piece take the
+// piece's route; data that leaves at once on each hop arrives `duration` after it was sent,
+// and data that waits for a contact to start arrives at earliest_arrival. Departures covered
+// by no piece cannot reach the destination.
+class ArrivalProfile {
+public:
+    struct Piece {
+        int first_departure, last_departure;
+        // a departure at t in the piece arrives at max(t + duration, earliest_arrival)
+        int duration, earliest_arrival;
+        Route route;
+    };
+    // in departure order, not overlapping
+    std::vector<Piece> pieces;
+    // earliest arrival for data sent at departure, or MAX_SIZE if it cannot be delivered
+    int arrival_time(int departure) const;
+    // Earliest arrival route for data sent at departure; an empty Route if there is none
+    Route route(int departure) const;
+};
+
+
+// Earliest arrival routing with the Connection Scan Algorithm: a single pass over the contacts
+// sorted by start time, keeping one arrival time per node, instead of a priority queue search.
+// The pass starts at the first contact that can still be open at the query's start time and
+// stops at the first contact starting after the destination has been reached.
+// A contact is an interval, so the pass may reach a node while contacts from it that were
+// already scanned are still open. Those contacts are relaxed again ("replayed") right away,
+// which keeps the pass exact without rescanning the plan.
+// Like MultigraphRouter it is immutable after construction, and the const route() and profile()
+// may be called concurrently with a workspace per thread.
+class ConnectionScanRouter {
+public:
+    ConnectionScanRouter(const std::vector<Contact> &contact_plan);
+    // Earliest arrival route from source to destination for data ready at source at start_time.
+    // Returns an empty Route (no hops) if destination cannot be reached.
+    Route route(nodeId_t source, nodeId_t destination, int start_time);
+    Route route(ConnectionScanWorkspace &ws, nodeId_t source, nodeId_t destination, int start_time) const;
+    // Earliest arrival profile for every departure time in [first_departure, last_departure],
+    // from one backward pass over the contacts (profile connection scan). Every node keeps its
+    // own profile: for each time, the way on to the destination (a route suffix) that arrives
+    // earliest. Contacts are scanned by decreasing start time and extend the profile of their
+    // receiving node into that of their sending node; as in route(), contacts already scanned
+    // are replayed when a node's profile improves.
+    ArrivalProfile profile(nodeId_t source, nodeId_t destination, int first_departure, int last_departure);
+    ArrivalProfile profile(ConnectionScanWorkspace &ws, nodeId_t source, nodeId_t destination, int first_departure,
+                           int last_departure) const;
+private:
+    // contacts sorted by start time, and their sending and receiving dense vertex indices
+    ContactStore contacts;
+    std::vector<uint32_t> frm, to;
+    std::vector<nodeId_t> node_ids;
+    // the contacts sent by vertex v are out_contacts[out_offsets[v]..out_offsets[v+1]), by start time
+    std::vector<uint32_t> out_offsets, out_contacts;
+    // the contacts received by vertex v are in_contacts[in_offsets[v]..in_offsets[v+1]), by start time
+    std::vector<uint32_t> in_offsets, in_contacts;
+    // longest contact duration, which bounds how long before a time a contact open at it started
+    int max_duration;
+    ConnectionScanWorkspace workspace;
+    uint32_t vertex_index(nodeId_t id) const;
+    // Relaxes contact c for data that reaches its sending vertex at arrival_time
+    void relax(ConnectionScanWorkspace &ws, uint32_t c, int arrival_time) const;
+    // Earliest arrival times from vertex src for data ready at start_time, over the contacts
+    // that start by last_start; the pass stops early once dst is reached, unless dst is NO_INDEX
+    void scan(ConnectionScanWorkspace &ws, uint32_t src, uint32_t dst, int start_time, int last_start) const;
+};
+
+
+    // Reads a JSON contact plan. A contact with a "period" and a "repeat" count or an "until"
+    // time is periodic: the first overload expands it into its occurrences, the second one
+    // returns it in periodic_contacts. max_contacts limits the number of entries read.
     std::vector<Contact> cp_load(std::string filename, int max_contacts=MAX_SIZE);
-    Route dijkstra(Contact *root_contact, nodeId_t destination, std::vector<Contact> contact_plan);
-    Route cmr_dijkstra(Contact* root_contact, nodeId_t destination, std::vector<Contact> contact_plan);
-    std::vector<Route> yen(nodeId_t source, nodeId_t destination, int currTime, std::vector<Contact> contactPlan, int numRoutes);
+    std::vector<Contact> cp_load(std::string filename, std::vector<PeriodicContact> &periodic_contacts,
+                                 int max_contacts=MAX_SIZE);
+    // Writes contact_plan as a binary contact plan: a versioned little-endian image of the
+    // ContactMultigraph arrays that ContactMultigraph/MultigraphRouter can map and route over.
+    void cp_save_binary(const std::vector<Contact> &contact_plan, std::string filename);
+    Route dijkstra(Contact *root_contact, nodeId_t destination, const std::vector<Contact> &contact_plan);
+    Route cmr_dijkstra(Contact* root_contact, nodeId_t destination, const std::vector<Contact> &contact_plan);
+    // k shortest routes over a MultigraphRouter built for this query; the spur searches run on
+    // `pool` if one is given, otherwise on the calling thread
+    std::vector<Route> yen(nodeId_t source, nodeId_t destination, int currTime, const std::vector<Contact> &contactPlan, int numRoutes,
+                           ThreadPool *pool = NULL);
 
-template <typename T>   bool vector_contains(std::vector<T> vec, T ele);
+template <typename T>   bool vector_contains(const std::vector<T> &vec, const T &ele);
 
 class EmptyContainerError: public std::exception {
     virtual const char* what() const throw();
 };
+
+// Thrown when a contact plan file cannot be read, is not valid JSON,
+// or is not a binary contact plan this version understands
+class ContactPlanError: public std::runtime_error {
+public:
+    ContactPlanError(const std::string &message);
+};
     std::ostream& operator<<(std::ostream &out, const std::vector<Contact> &obj);  std::ostream& operator<<(std::ostream &out, const Contact &obj); std::ostream& operator<<(std::ostream &out, const Route &obj);
 
 
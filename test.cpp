@@ -57,5 +57,80 @@ int main() {
 		std::cout << "Hop " << i << ": " << hops[i] << std::endl;
 	}
 
+	// k shortest routes: 1->2->4 over the first contacts is best, followed by the other 1->2 and 2->4 contact combinations
+	std::vector<Route> routes = yen(1, dest_id, 0, contact_plan, 4);
+	for (std::size_t i = 0; i < routes.size(); ++i) {
+		std::cout << "Route " << i << ": " << routes[i] << std::endl;
+	}
+
+	// one search from node 1 gives the routes to every node
+	MultigraphRouter router(contact_plan);
+	RouteTree tree = router.route_tree(1, 0);
+	for (nodeId_t node : { 2, 3, 4, 200 }) {
+		std::cout << "Arrival at " << node << ": " << tree.arrival_time(node) << " " << tree.route(node) << std::endl;
+	}
+
+	// a burst of queries answered in parallel, routes come back in query order
+	std::vector<RouteQuery> queries = { { 1, 4, 0 }, { 1, 3, 0 }, { 2, 200, 0 } };
+	ThreadPool pool(2);
+	std::vector<Route> batch = router.route_batch(queries, &pool);
+	for (std::size_t i = 0; i < batch.size(); ++i) {
+		std::cout << "Query " << i << ": " << batch[i] << std::endl;
+	}
+
+	// the route departing at 0 is still the best one departing at 5, so the second lookup hits
+	RouteCache cache(router);
+	cache.route(1, 4, 0);
+	cache.route(1, 4, 5);
+	std::cout << "Route cache hits: " << cache.hits() << " misses: " << cache.misses() << std::endl;
+
+	// plan update: without the first 1->2 contact the route to 4 takes another one
+	router.graph().remove_contact(hops[0]);
+	std::cout << "After update " << router.graph().version() << ": " << router.route(1, 4, 0) << std::endl;
+
+	// the tree from node 1 is repaired in place when the first contact on its route to 4 goes away
+	tree = router.route_tree(1, 0);
+	router.remove_contact(tree, tree.route(4).get_hops()[0]);
+	std::cout << "Repaired arrival at 4: " << tree.arrival_time(4) << " " << tree.route(4) << std::endl;
+
+	// moving the time window to 150 drops the contacts that have ended by then
+	router.graph().advance(150);
+	std::cout << "Window at " << router.graph().now() << ": " << router.graph().num_contacts() << " contacts, "
+		<< router.route(2, 4, 150) << std::endl;
+
+	// a pass repeating every 100 time units is stored once; data ready at 20 waits for the second pass
+	std::vector<PeriodicContact> passes = { PeriodicContact(Contact(1, 2, 0, 10, 1000), 100, 3) };
+	MultigraphRouter periodic_router(std::vector<Contact>(), passes);
+	std::cout << "Periodic route: " << periodic_router.route(1, 2, 20) << std::endl;
+	// updates apply to stored contacts only, so changing the rate of an occurrence is refused
+	std::cout << "Occurrence rate changed: " << periodic_router.graph().set_rate(passes[0].occurrence(1), 500) << std::endl;
+	// occurrence times are ints, so a pass whose last occurrence would end past the largest one is refused
+	try {
+		PeriodicContact(Contact(1, 2, 0, 10, 1000), std::numeric_limits<int>::max() / 2, 3);
+	}
+	catch (const std::invalid_argument &e) {
+		std::cout << "Periodic contact refused: " << e.what() << std::endl;
+	}
+
+	// contacts of one pair may overlap: the short-delay contact starting at 5 arrives first, and an
+	// added contact open during both of them arrives earlier still
+	std::vector<Contact> overlapping = { Contact(1, 2, 0, 100, 1000, 1.0, 10), Contact(1, 2, 5, 50, 1000, 1.0, 1) };
+	MultigraphRouter overlap_router(overlapping);
+	std::cout << "Overlapping route: " << overlap_router.route(1, 2, 0) << std::endl;
+	std::cout << "Connection scan: " << ConnectionScanRouter(overlapping).route(1, 2, 0) << std::endl;
+	overlap_router.graph().add_contact(Contact(1, 2, 2, 30, 1000, 1.0, 0));
+	std::cout << "After adding an overlapping contact: " << overlap_router.route(1, 2, 0) << std::endl;
+
+	// one pass over the contacts in start time order finds the same earliest arrival route
+	ConnectionScanRouter scan_router(contact_plan);
+	std::cout << "Connection scan: " << scan_router.route(1, dest_id, 0) << std::endl;
+
+	// arrival times for every departure from 0 to 100 in one call, piece by piece
+	ArrivalProfile arrival_profile = scan_router.profile(1, dest_id, 0, 100);
+	for (const ArrivalProfile::Piece &piece : arrival_profile.pieces) {
+		std::cout << "Depart " << piece.first_departure << "-" << piece.last_departure << ": arrive "
+			<< arrival_profile.arrival_time(piece.first_departure) << "-" << arrival_profile.arrival_time(piece.last_departure) << std::endl;
+	}
+
 	return 0;
 }